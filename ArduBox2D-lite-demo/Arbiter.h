@@ -1,109 +1,188 @@
-/*
-* Copyright (c) 2006-2009 Erin Catto http://www.gphysics.com
-*
-* Permission to use, copy, modify, distribute and sell this software
-* and its documentation for any purpose is hereby granted without fee,
-* provided that the above copyright notice appear in all copies.
-* Erin Catto makes no representations about the suitability 
-* of this software for any purpose.  
-* It is provided "as is" without express or implied warranty.
-* 
-* 
-  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
-  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
-  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
-    
-*/
-
-#ifndef ARBITER_H
-#define ARBITER_H
-
-#include "MathUtils.h"
-
-#include <FixedPoints.h>
-#include <FixedPointsCommon.h>
-#include <ArduinoSTL.h>
-struct Body;
-
-union FeaturePair
-{
-  struct Edges
-  {
-    char inEdge1;
-    char outEdge1;
-    char inEdge2;
-    char outEdge2;
-  } e;
-  int value;
-};
-
-struct Contact
-{
-  Contact() : Pn(0.0), Pt(0.0), Pnb(0.0) {}
-
-  Vec2 position;
-  Vec2 normal;
-  Vec2 r1, r2;
-  SQ7x8 separation;
-  SQ7x8 Pn; // accumulated normal impulse
-  SQ7x8 Pt; // accumulated tangent impulse
-  SQ7x8 Pnb;  // accumulated normal impulse for position bias
-  SQ7x8 massNormal, massTangent;
-  SQ7x8 bias;
-  FeaturePair feature;
-};
-
-struct ArbiterKey
-{
-  ArbiterKey(Body* b1, Body* b2)
-  {
-    if (b1 < b2)
-    {
-      body1 = b1; body2 = b2;
-    }
-    else
-    {
-      body1 = b2; body2 = b1;
-    }
-  }
-
-  Body* body1;
-  Body* body2;
-};
-
-struct Arbiter
-{
-  enum {MAX_POINTS = 2};
-
-  Arbiter(Body* b1, Body* b2);
-
-  void Update(Contact* contacts, int numContacts);
-
-  void PreStep(SQ7x8 inv_dt);
-  void ApplyImpulse();
-
-  Contact contacts[MAX_POINTS];
-  int numContacts;
-
-  Body* body1;
-  Body* body2;
-
-  // Combined friction
-  SQ7x8 friction;
-};
-
-// This is used by std::set
-inline bool operator < (const ArbiterKey& a1, const ArbiterKey& a2)
-{
-  if (a1.body1 < a2.body1)
-    return true;
-
-  if (a1.body1 == a2.body1 && a1.body2 < a2.body2)
-    return true;
-
-  return false;
-}
-
-int Collide(Contact* contacts, Body* body1, Body* body2);
-
-#endif
+/*
+* Copyright (c) 2006-2009 Erin Catto http://www.gphysics.com
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Erin Catto makes no representations about the suitability 
+* of this software for any purpose.  
+* It is provided "as is" without express or implied warranty.
+* 
+* 
+  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
+  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
+  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
+    
+*/
+
+#ifndef ARBITER_H
+#define ARBITER_H
+
+#include "Config.h"
+#include "MathUtils.h"
+
+#include <FixedPoints.h>
+#include <FixedPointsCommon.h>
+#include <ArduinoSTL.h>
+struct Body;
+struct World;
+struct StepArena;
+
+// Edge numbers are 0-4 (see Collide.cpp), so all four fit in 16 bits.
+union FeaturePair
+{
+  struct Edges
+  {
+    uint8_t inEdge1 : 4;
+    uint8_t outEdge1 : 4;
+    uint8_t inEdge2 : 4;
+    uint8_t outEdge2 : 4;
+  } e;
+  uint16_t value;
+};
+
+// The part of a contact point that persists between steps: what is needed to
+// recognise the point next step and warm start it.
+struct Contact
+{
+#if ARDUBOX2D_MASS_CACHE
+  // The denominators are never negative, so new points always miss the cache.
+  Contact() : Pn(0.0), Pt(0.0), Pnb(0.0), kNormal(-1.0), kTangent(-1.0) { feature.value = 0; }
+#else
+  Contact() : Pn(0.0), Pt(0.0), Pnb(0.0) { feature.value = 0; }
+#endif
+
+  SQ7x8 Pn; // accumulated normal impulse
+  SQ7x8 Pt; // accumulated tangent impulse
+  SQ7x8 Pnb;  // accumulated normal impulse for position bias
+  FeaturePair feature;
+
+#if ARDUBOX2D_MASS_CACHE
+  // Effective masses and the denominators they are the reciprocals of.
+  SQ7x8 kNormal, massNormal;
+  SQ7x8 kTangent, massTangent;
+#endif
+};
+
+// Everything else about a contact point. Collide() fills in the geometry and
+// PreStep the rest. These live in World::solverContacts and are rebuilt by
+// every BroadPhase, so they only take up RAM once, not once per arbiter.
+struct SolverContact
+{
+  Vec2 position;
+  Vec2 normal;
+  Vec2 r1, r2;
+  SQ7x8 separation;
+  SQ7x8 massNormal, massTangent;
+  SQ7x8 bias;
+  FeaturePair feature;
+};
+
+// What UpdateManifold() needs to move last step's clip points instead of
+// clipping again: which faces they came from, and the clip points themselves
+// in the incident box's frame. face is ReferenceFace::face in Collide.cpp.
+struct ManifoldCache
+{
+  enum {NONE = 0xFF};
+
+  ManifoldCache() : face(NONE) {}
+
+  uint8_t face;
+  uint8_t incidentEdge;
+  uint8_t separated;  // bit i set if clip point i was not a contact
+  uint8_t age;        // steps since the last full clip
+  Vec2 localPoints[2];
+  FeaturePair features[2];
+};
+
+// Bodies are identified by Body::index, see World::GetBody.
+struct ArbiterKey
+{
+  ArbiterKey(uint8_t b1, uint8_t b2)
+  {
+    if (b1 < b2)
+    {
+      body1 = b1; body2 = b2;
+    }
+    else
+    {
+      body1 = b2; body2 = b1;
+    }
+  }
+
+  uint8_t body1;
+  uint8_t body2;
+};
+
+// Index into World::solverContacts. An AVR's arena holds far fewer than 255
+// points; a host's can hold more.
+#ifdef __AVR__
+typedef uint8_t SolverIndex;
+#else
+typedef uint16_t SolverIndex;
+#endif
+
+struct Arbiter
+{
+  enum {MAX_POINTS = 2};
+  enum {NO_SOLVER_CONTACTS = SolverIndex(~0)};
+
+  Arbiter(const ArbiterKey& key, const Body* b1, const Body* b2);
+
+  // Takes over the points Collide() produced this step, carrying the
+  // accumulated impulses of matching features forward.
+  void Update(const SolverContact* newContacts, int numNewContacts);
+
+  // Instantiated for DefaultSolverPolicy and RuntimeSolverPolicy (World.h).
+  template<class Policy> void PreStep(World& world, SQ7x8 inv_dt);
+  template<class Policy> void ApplyImpulse(World& world);
+
+  Contact contacts[MAX_POINTS];
+  uint8_t numContacts;
+
+  uint8_t body1;
+  uint8_t body2;
+
+  // Index of this step's first point in World::solverContacts, or
+  // NO_SOLVER_CONTACTS if the buffer ran out and the arbiter sits this step out.
+  SolverIndex firstSolverContact;
+
+  // Combined friction
+  SQ7x8 friction;
+
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+  ManifoldCache manifold;
+#endif
+
+  // Next arbiter in body1's and body2's Body::arbiterList.
+  Arbiter* next1;
+  Arbiter* next2;
+};
+
+// This is used by std::set
+inline bool operator < (const ArbiterKey& a1, const ArbiterKey& a2)
+{
+  if (a1.body1 < a2.body1)
+    return true;
+
+  if (a1.body1 == a2.body1 && a1.body2 < a2.body2)
+    return true;
+
+  return false;
+}
+
+// Returns the number of contact points, or -1 if scratch ran out of space.
+// The second form takes the bodies' rotation matrices, e.g. cached ones.
+int Collide(SolverContact* contacts, Body* body1, Body* body2, StepArena& scratch);
+int Collide(SolverContact* contacts, Body* body1, const Mat22& rot1, Body* body2, const Mat22& rot2, StepArena& scratch);
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+// Collide() for a pair that may have touched last step: moves the points in
+// cache with the incident box instead of clipping, unless the reference face,
+// incident edge or a point's side of the face changed, or cache is older than
+// ARDUBOX2D_INCREMENTAL_MANIFOLD steps.
+int UpdateManifold(SolverContact* contacts, Body* body1, const Mat22& rot1, Body* body2, const Mat22& rot2, StepArena& scratch, ManifoldCache& cache);
+#endif
+bool TestOverlap(Body* body1, Body* body2);
+void Flip(FeaturePair& fp);
+
+#endif
@@ -1,140 +1,220 @@
-/*
-  This is a proof of concept program for the Arduboy and other small micros that simulates the physics of
-  multiple rigid bodies in 2D space. Complete with complex collisions! It is a modification of Box2D-lite
-  that uses Pharap's FixedPointsArduino library in place of all the floating point operations.
-
-  More info: https://github.com/Physics-Dude/ArduBox2D-lite
-
-  Further reading:
-    Required: Pharap's FixedPointsArduino: https://github.com/Pharap/FixedPointsArduino/
-    Required: mike-matera's ArduinoSTL: https://github.com/mike-matera/ArduinoSTL
-    Required: Arduboy2 (only using it for drawing) https://github.com/MLXXXp/Arduboy2
-
-    Not required, but uses physics code from: https://github.com/erincatto/box2d-lite
-    More info on Arduboy https://community.arduboy.com/t/documentation/7836
-*/
-
-#include "Arduino.h"
-#include <Arduboy2.h>
-
-#include <FixedPoints.h>
-#include <FixedPointsCommon.h>
-
-#include <ArduinoSTL.h>
-#include <vector>
-#include <map>
-
-#include "World.h"
-#include "Body.h"
-
-Arduboy2 arduboy;
-
-const SQ7x8 FLT_MAX = 127.99; //temp
-
-namespace {
-Body bodies[5];
-SQ7x8 timeStep = 1.0 / 60.0;
-int iterations = 2;
-Vec2 gravity(0.0, -9.8);
-int numBodies = 0;
-int width = 128;
-int height = 64;
-int simCenterX = 64; //x pos for sim 0,0
-World world(gravity, iterations);
-}
-
-//From box2d-lite but adapted for arduboy.
-static void DrawBody(Body* body) {
-  Mat22 R(body->rotation);
-  Vec2 x = body->position;
-  Vec2 h = 0.5 * body->width;
-
-  Vec2 v1 = x + R * Vec2(-h.x, -h.y);
-  Vec2 v2 = x + R * Vec2( h.x, -h.y);
-  Vec2 v3 = x + R * Vec2( h.x,  h.y);
-  Vec2 v4 = x + R * Vec2(-h.x,  h.y);
-
-  arduboy.drawLine((int8_t)roundFixed(v1.x) + simCenterX, height - (int8_t)roundFixed(v1.y), (int8_t)roundFixed(v2.x) + simCenterX, height - (int8_t)roundFixed(v2.y), WHITE);
-  arduboy.drawLine((int8_t)roundFixed(v2.x) + simCenterX, height - (int8_t)roundFixed(v2.y), (int8_t)roundFixed(v3.x) + simCenterX, height - (int8_t)roundFixed(v3.y), WHITE);
-  arduboy.drawLine((int8_t)roundFixed(v3.x) + simCenterX, height - (int8_t)roundFixed(v3.y), (int8_t)roundFixed(v4.x + simCenterX), height - (int8_t)roundFixed(v4.y), WHITE);
-  arduboy.drawLine((int8_t)roundFixed(v4.x) + simCenterX, height - (int8_t)roundFixed(v4.y), (int8_t)roundFixed(v1.x) + simCenterX, height - (int8_t)roundFixed(v1.y), WHITE);
-}
-
-
-static void Demo4(Body* b, bool oneMore = false) {
-  if (oneMore) {
-    b->Set(Vec2(5.0, 5.0), 0.25);
-    b->friction = 0.2;
-    b->angularVelocity = -10.0;
-    b->position.Set(-64, 10);
-    b->velocity.Set(60, 25);
-    world.Add(b);
-    ++b; ++numBodies;
-  }
-  // Floor
-  b->Set(Vec2(100.0, 20.0), FLT_MAX);
-  b->friction = 0.2;
-  b->position.Set(0, -9); //center of rectangle;
-  b->rotation = 0.0;
-  world.Add(b);
-  ++b; ++numBodies;
-
-  //Spinning toy
-  b->Set(Vec2(5.0, 10.0), 1.0);
-  b->friction = 0.2;
-  b->angularVelocity = -8.0;
-  b->position.Set(5, 60);
-  world.Add(b);
-  ++b; ++numBodies;
-
-  //Tiny stack
-  for (int i = 0; i < 2; ++i)
-  {
-    b->Set(Vec2(8.0, 15.0), 1.0);
-    b->friction = 0.2;
-    b->rotation = 0;
-    b->position.Set(0, 1.1 * b->width.y * (1 + i) - 5);
-    world.Add(b);
-    ++b; ++numBodies;
-  }
-}
-
-void setup() {
-  arduboy.begin();
-  world.Clear();
-  numBodies = 0;
-  Demo4(bodies);
-}
-
-bool isRunning = true;
-void loop() {
-  if (!arduboy.nextFrame())
-    return;
-  arduboy.pollButtons();
-  arduboy.clear();
-
-  if (isRunning) world.Step(timeStep);
-
-  for (int i = 0; i < numBodies; ++i)
-    DrawBody(bodies + i);
-
-  // Create a new body
-  if (arduboy.justPressed(RIGHT_BUTTON | LEFT_BUTTON | UP_BUTTON | DOWN_BUTTON )) {
-    world.Clear();
-    numBodies = 0;
-    Demo4(bodies, true);
-  }
-
-  //Reset the simulation.
-  if (arduboy.justPressed(B_BUTTON)) {
-    world.Clear();
-    numBodies = 0;
-    Demo4(bodies);
-  }
-
-  //pause
-  if (arduboy.justPressed(A_BUTTON)) {
-    isRunning = !isRunning;
-  }
-  arduboy.display();
-}
+/*
+  This is a proof of concept program for the Arduboy and other small micros that simulates the physics of
+  multiple rigid bodies in 2D space. Complete with complex collisions! It is a modification of Box2D-lite
+  that uses Pharap's FixedPointsArduino library in place of all the floating point operations.
+
+  More info: https://github.com/Physics-Dude/ArduBox2D-lite
+
+  Further reading:
+    Required: Pharap's FixedPointsArduino: https://github.com/Pharap/FixedPointsArduino/
+    Required: mike-matera's ArduinoSTL: https://github.com/mike-matera/ArduinoSTL
+    Required: Arduboy2 (only using it for drawing) https://github.com/MLXXXp/Arduboy2
+
+    Not required, but uses physics code from: https://github.com/erincatto/box2d-lite
+    More info on Arduboy https://community.arduboy.com/t/documentation/7836
+*/
+
+#include "Arduino.h"
+#include <Arduboy2.h>
+
+#include <FixedPoints.h>
+#include <FixedPointsCommon.h>
+
+#include <ArduinoSTL.h>
+#include <vector>
+#include <map>
+
+#include "World.h"
+#include "Body.h"
+#include "Benchmark.h"
+#include "CycleCounter.h"
+#include "Render.h"
+#include "Scene.h"
+
+Arduboy2 arduboy;
+
+const SQ7x8 FLT_MAX = 127.99; //temp
+
+namespace {
+SQ7x8 timeStep = 1.0 / 60.0;
+int iterations = 2;
+Vec2 gravity(0.0, -9.8);
+int width = 128;
+int height = 64;
+int simCenterX = 64; //x pos for sim 0,0
+World world(gravity, iterations);
+
+// Projectiles in the order they were fired, oldest first.
+Body* shots[BodyPool::SIZE];
+int numShots = 0;
+
+#if ARDUBOX2D_RENDER_BUFFER
+RenderBuffer renderBuffer;
+#endif
+}
+
+//From box2d-lite but adapted for arduboy. The corners come from the
+//engine, which already transformed them for collision.
+static void DrawBody(const Vec2 vertices[4]) {
+  ScreenQuad q;
+  ToScreen(vertices, simCenterX, height, q);
+
+  for (int i = 0; i < 4; ++i) {
+    int j = (i + 1) & 3;
+    arduboy.drawLine(q.x[i], q.y[i], q.x[j], q.y[j], WHITE);
+  }
+}
+
+// Bodies placed by hand since the last BroadPhase, e.g. fired or reset
+// while paused, still have the corners Body::Set left at the origin.
+static void DrawBody(const Body* b) {
+  if (b->transformDirty) {
+    Vec2 vertices[4];
+    b->ComputeVertices(vertices);
+    DrawBody(vertices);
+  } else {
+    DrawBody(b->vertices);
+  }
+}
+
+// Draws the world as the last finished step, and any input since, left it.
+// While running it sits between BeginStep and EndStep, where nothing has
+// moved yet; while paused no step runs, so dirty bodies are transformed
+// here.
+static void DrawWorld() {
+#if ARDUBOX2D_RENDER_BUFFER
+  const RenderBody* bodies = renderBuffer.Front();
+  for (int i = 0; i < renderBuffer.FrontCount(); ++i)
+    DrawBody(bodies[i].vertices);
+#else
+  for (int i = 0; i < (int)world.staticBodies.size(); ++i)
+    DrawBody(world.staticBodies[i]);
+  for (int i = 0; i < (int)world.bodies.size(); ++i)
+    DrawBody(world.bodies[i]);
+#endif
+}
+
+
+const SceneBody demo4Scene[] PROGMEM = {
+  // Floor
+  SceneStaticBox(100.0, 20.0).At(0.0, -9.0), //center of rectangle;
+
+  //Spinning toy
+  SceneBox(5.0, 10.0, 1.0).At(5.0, 60.0).Spin(-8.0),
+
+  //Tiny stack
+  SceneBox(8.0, 15.0, 1.0).At(0.0, 1.1 * 15.0 * 1 - 5),
+  SceneBox(8.0, 15.0, 1.0).At(0.0, 1.1 * 15.0 * 2 - 5),
+};
+
+static void Demo4() {
+  LoadScene(world, demo4Scene, sizeof(demo4Scene) / sizeof(demo4Scene[0]));
+}
+
+// Throws a small box in from the left. Once the pool is empty the oldest
+// projectile is recycled, so the rest of the scene keeps its state.
+static void Fire() {
+  Body* b = world.Create(Vec2(5.0, 5.0), 0.25);
+  if (!b && numShots > 0) {
+    world.Destroy(shots[0]);
+    --numShots;
+    for (int i = 0; i < numShots; ++i)
+      shots[i] = shots[i + 1];
+    b = world.Create(Vec2(5.0, 5.0), 0.25);
+  }
+  if (!b)
+    return;
+
+  b->friction = 0.2;
+  b->angularVelocity = -10.0;
+  b->SetPosition(Vec2(-64, 10));
+  b->velocity.Set(60, 25);
+  shots[numShots++] = b;
+}
+
+static void Reset() {
+  world.Clear();
+  numShots = 0;
+  Demo4();
+}
+
+void setup() {
+#if ARDUBOX2D_BENCHMARK == 2
+  // Under simavr: skip the display, print on the UART and stop when done.
+  Serial1.begin(115200);
+  RunBenchmark(Serial1);
+  EndBenchmarkRun();
+#endif
+
+  arduboy.begin();
+  StartCycleCounter();
+#if ARDUBOX2D_STATS || ARDUBOX2D_BENCHMARK
+  Serial.begin(9600);
+#endif
+#if ARDUBOX2D_BENCHMARK == 1
+  while (!Serial);
+  RunBenchmark(Serial);
+#endif
+
+  // Bodies that leave the screen drop to reduced-rate stepping.
+  AABB screen;
+  screen.lowerBound.Set(-simCenterX, 0);
+  screen.upperBound.Set(width - simCenterX, height);
+  world.SetView(screen);
+
+  Reset();
+#if ARDUBOX2D_RENDER_BUFFER
+  world.SetRenderBuffer(&renderBuffer);
+#endif
+}
+
+bool isRunning = true;
+void loop() {
+  if (!arduboy.nextFrame())
+    return;
+  arduboy.pollButtons();
+  arduboy.clear();
+
+  // Input changes the world between steps only.
+  bool changed = false;
+
+  // Create a new body
+  if (arduboy.justPressed(RIGHT_BUTTON | LEFT_BUTTON | UP_BUTTON | DOWN_BUTTON )) {
+    Fire();
+    changed = true;
+  }
+
+  //Reset the simulation.
+  if (arduboy.justPressed(B_BUTTON)) {
+    Reset();
+    changed = true;
+  }
+
+  //pause
+  if (arduboy.justPressed(A_BUTTON)) {
+    isRunning = !isRunning;
+  }
+
+#if ARDUBOX2D_RENDER_BUFFER
+  // Show the change now, even while paused.
+  if (changed) renderBuffer.Publish(world);
+#else
+  (void)changed;
+#endif
+
+  // While running, the step is split around the drawing, which needs only
+  // what the last step left. While paused only the drawing runs.
+  if (isRunning) world.BeginStep(timeStep);
+  DrawWorld();
+  if (isRunning) world.EndStep();
+
+#if ARDUBOX2D_STATS
+  // Dump the engine counters once a second.
+  if (arduboy.everyXFrames(60)) {
+    World::stats.PrintTo(Serial);
+    World::stats.Reset();
+  }
+#endif
+
+  arduboy.display();
+}
@@ -0,0 +1,64 @@
+/*
+  Bump allocator for data that only lives for one World::Step.
+
+  World::BroadPhase resets the arena and then carves the candidate pair list,
+  the solver contacts and Collide()'s clipping buffers out of it. Nothing is
+  freed individually; Mark/Rewind hand back the top of the arena for
+  short-lived buffers. highWater records the most the arena has ever held, so
+  run the heaviest scene once and set ARDUBOX2D_ARENA_SIZE to match.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+#include "Config.h"
+
+#ifndef ARDUBOX2D_ARENA_SIZE
+#define ARDUBOX2D_ARENA_SIZE 384
+#endif
+
+struct StepArena
+{
+  enum {SIZE = ARDUBOX2D_ARENA_SIZE};
+
+  StepArena() : used(0), highWater(0), failedAllocations(0) {}
+
+  void Reset() { used = 0; }
+
+  uint16_t Mark() const { return used; }
+  void Rewind(uint16_t mark) { used = mark; }
+
+  // Returns uninitialised space for count objects of type T, or 0 (and counts
+  // a failure) if the arena is full. Consecutive allocations of the same type
+  // are contiguous.
+  template<typename T> T* Allocate(uint16_t count)
+  {
+    uint16_t start = (used + alignof(T) - 1) & ~(uint16_t)(alignof(T) - 1);
+    uint32_t end = (uint32_t)start + (uint32_t)count * sizeof(T);
+    if (end > SIZE)
+    {
+      if (failedAllocations < 0xFFFF)
+        ++failedAllocations;
+      return 0;
+    }
+
+    used = end;
+    if (used > highWater)
+      highWater = used;
+    return reinterpret_cast<T*>(storage.bytes + start);
+  }
+
+  union
+  {
+    uint8_t bytes[SIZE];
+    void* align;
+  } storage;
+
+  uint16_t used;
+  uint16_t highWater;
+  uint16_t failedAllocations;
+};
+
+#endif
@@ -0,0 +1,449 @@
+/*
+  On-device benchmark for the engine. See Benchmark.h.
+*/
+
+#include "Benchmark.h"
+
+#if ARDUBOX2D_BENCHMARK
+
+#include <Arduino.h>
+#include <math.h>
+
+#include "World.h"
+#include "Body.h"
+#include "CycleCounter.h"
+#include "Reciprocal.h"
+#include "Reference.h"
+#include "Scene.h"
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#endif
+
+namespace {
+
+const int k_steps = 120;
+const SQ7x8 k_timeStep = 1.0 / 60.0;
+
+// A pile's bin takes three statics.
+Body bodies[ARDUBOX2D_BENCHMARK_MAX_BODIES + 3];
+World world(Vec2(0.0, -9.8), 2);
+
+#ifndef __AVR__
+ReferenceWorld reference;
+#endif
+
+typedef void (*BuildFunction)(int count);
+
+// The demo's scene.
+const SceneBody demo4Scene[] PROGMEM = {
+  SceneStaticBox(100.0, 20.0).At(0.0, -9.0),
+  SceneBox(5.0, 10.0, 1.0).At(5.0, 60.0).Spin(-8.0),
+  SceneBox(8.0, 15.0, 1.0).At(0.0, 1.1 * 15.0 * 1 - 5),
+  SceneBox(8.0, 15.0, 1.0).At(0.0, 1.1 * 15.0 * 2 - 5),
+};
+
+void BuildDemo4(int)
+{
+  world.Clear();
+  LoadScene(world, demo4Scene, sizeof(demo4Scene) / sizeof(demo4Scene[0]));
+}
+
+// The demo's floor with a short stack of boxes resting on it.
+void BuildStack(int count)
+{
+  world.Clear();
+
+  Body* b = bodies;
+  b->Set(Vec2(100.0, 20.0), 127.99);
+  b->position.Set(0, -9);
+  world.Add(b++);
+
+  for (int i = 0; i < count; ++i)
+  {
+    b->Set(Vec2(8.0, 6.0), 1.0);
+    // The floor's top is at y = 1; leave a small gap under each box.
+    b->position.Set(0.25 * (i & 1), 4.1 + 6.1 * i);
+    world.Add(b++);
+  }
+}
+
+// Boxes dropped into a bin in staggered rows of five.
+void BuildPile(int count)
+{
+  world.Clear();
+
+  Body* b = bodies;
+  b->Set(Vec2(40.0, 4.0), 127.99);
+  b->position.Set(0, -2);
+  world.Add(b++);
+
+  for (int side = -1; side <= 1; side += 2)
+  {
+    b->Set(Vec2(2.0, 40.0), 127.99);
+    b->position.Set(14 * side, 18);
+    world.Add(b++);
+  }
+
+  for (int i = 0; i < count; ++i)
+  {
+    b->Set(Vec2(4.0, 4.0), 1.0);
+    b->position.Set(-10 + 5 * (i % 5) + ((i / 5) & 1), 3 + 5 * (i / 5));
+    world.Add(b++);
+  }
+}
+
+#ifdef __AVR__
+
+extern "C" char __heap_start;
+extern "C" char* __brkval;
+
+const uint8_t k_paint = 0xC5;
+
+char* HeapEnd()
+{
+  return __brkval ? __brkval : &__heap_start;
+}
+
+// Fills the RAM between the heap and this function's frame with k_paint.
+void PaintFreeRam()
+{
+  char* top = reinterpret_cast<char*>(SP) - 16;
+  for (char* p = HeapEnd(); p < top; ++p)
+    *p = k_paint;
+}
+
+// Bytes from the top of RAM down to the deepest the stack reached, found as
+// the first byte above the heap's high water that is no longer painted.
+uint16_t StackDepth(const char* heapHighWater)
+{
+  const char* p = heapHighWater;
+  while (p < reinterpret_cast<const char*>(RAMEND) && *reinterpret_cast<const uint8_t*>(p) == k_paint)
+    ++p;
+  return reinterpret_cast<const char*>(RAMEND) - p + 1;
+}
+
+#endif
+
+void PrintPerStep(Print& out, const __FlashStringHelper* name, uint32_t total)
+{
+  out.print(name);
+  out.print(total / k_steps);
+}
+
+// Kinetic plus potential energy of the dynamic bodies.
+float Energy()
+{
+  float e = 0.0f;
+  for (int i = 0; i < (int)world.bodies.size(); ++i)
+  {
+    const Body* b = world.bodies[i];
+    if (b->invMass == 0.0)
+      continue;
+
+    float m = static_cast<float>(b->mass);
+    float vx = static_cast<float>(b->velocity.x), vy = static_cast<float>(b->velocity.y);
+    float w = static_cast<float>(b->angularVelocity);
+    e += 0.5f * m * (vx * vx + vy * vy) + 0.5f * static_cast<float>(b->I) * w * w;
+    e -= m * (static_cast<float>(world.gravity.x) * static_cast<float>(b->position.x) +
+              static_cast<float>(world.gravity.y) * static_cast<float>(b->position.y));
+  }
+  return e;
+}
+
+// How well a run kept to what the scene should do. Off AVR, the run is
+// compared with the float ReferenceWorld stepped alongside it from the same
+// start, same rounded time step and gravity, so the error is what the
+// fixed-point arithmetic costs. The other figures are against invariants and
+// are all the device gets: boxes should not sink into each other, the scene
+// should never gain energy, resting boxes should not slide, and a stack
+// should stay upright.
+struct Quality
+{
+  // A box tilted further than this, in radians, has toppled.
+  static SQ7x8 TipAngle() { return 0.5; }
+
+  void Start()
+  {
+    deepest = 0.0;
+    startEnergy = Energy();
+    energyGain = 0.0f;
+    upright = -1;
+    for (int i = 0; i < (int)world.bodies.size(); ++i)
+      startX[i] = world.bodies[i]->position.x;
+
+#ifndef __AVR__
+    reference.Load(world);
+    maxPositionError = 0.0f;
+    maxRotationError = 0.0f;
+    endPositionError = 0.0f;
+#endif
+  }
+
+  void Update(int step)
+  {
+    for (int i = 0; i < world.numSolverContacts; ++i)
+      deepest = Min(deepest, world.solverContacts[i].separation);
+
+    float gain = Energy() - startEnergy;
+    if (gain > energyGain)
+      energyGain = gain;
+
+    for (int i = 0; i < (int)world.bodies.size() && upright < 0; ++i)
+    {
+      if (Abs(world.bodies[i]->rotation) > TipAngle())
+        upright = step;
+    }
+
+#ifndef __AVR__
+    // Largest and, at the end, mean distance of the dynamic bodies from
+    // their float counterparts.
+    reference.Step(static_cast<float>(k_timeStep));
+    float sum = 0.0f;
+    for (int i = 0; i < reference.numDynamic; ++i)
+    {
+      const Body* b = world.bodies[i];
+      const RefBody& r = reference.Dynamic(i);
+      float dx = static_cast<float>(b->position.x) - r.position.x;
+      float dy = static_cast<float>(b->position.y) - r.position.y;
+      float error = sqrtf(dx * dx + dy * dy);
+      sum += error;
+      if (error > maxPositionError)
+        maxPositionError = error;
+      float rotationError = fabsf(static_cast<float>(b->rotation) - r.rotation);
+      if (rotationError > maxRotationError)
+        maxRotationError = rotationError;
+    }
+    endPositionError = reference.numDynamic ? sum / reference.numDynamic : 0.0f;
+#endif
+  }
+
+  // Summed speed and largest sideways drift of the dynamic bodies at the end,
+  // then the figures above.
+  void PrintTo(Print& out, bool isStack) const
+  {
+    int32_t speed = 0;
+    SQ7x8 drift = 0.0;
+    for (int i = 0; i < (int)world.bodies.size(); ++i)
+    {
+      const Body* b = world.bodies[i];
+      speed += abs(b->velocity.x.getInternal()) + abs(b->velocity.y.getInternal());
+      drift = Max(drift, Abs(b->position.x - startX[i]));
+    }
+
+    out.print(F("    deepest contact "));
+    out.print(static_cast<double>(-deepest), 2);
+    out.print(F(", energy gain "));
+    out.print(energyGain, 2);
+    out.print(F(", drift "));
+    out.print(static_cast<double>(drift), 2);
+    out.print(F(", speed sum "));
+    out.print(speed / 256.0, 2);
+    if (isStack)
+    {
+      out.print(F(", upright "));
+      out.print(upright < 0 ? k_steps : upright);
+      out.print(F(" of "));
+      out.print(k_steps);
+      out.print(F(" steps"));
+    }
+    out.println();
+
+#ifndef __AVR__
+    out.print(F("    vs float: position error "));
+    out.print(maxPositionError, 2);
+    out.print(F(" max, "));
+    out.print(endPositionError, 2);
+    out.print(F(" mean at end, rotation error "));
+    out.print(maxRotationError, 2);
+    out.println(F(" max"));
+#endif
+  }
+
+  SQ7x8 deepest;
+  float startEnergy;
+  float energyGain;
+  int upright;
+  SQ7x8 startX[ARDUBOX2D_BENCHMARK_MAX_BODIES + 3];
+#ifndef __AVR__
+  float maxPositionError;
+  float maxRotationError;
+  float endPositionError;
+#endif
+};
+
+// Steps a freshly built scene k_steps times and prints the cost per step,
+// per phase with ARDUBOX2D_STATS, the memory it needed and its Quality. Only
+// the steps themselves are timed.
+template<class Policy>
+void TimeScene(Print& out, const __FlashStringHelper* name, BuildFunction build, int count, bool isStack = false)
+{
+  build(count);
+#if ARDUBOX2D_STATS
+  World::stats.Reset();
+#endif
+  world.arena.highWater = 0;
+  world.arena.failedAllocations = 0;
+
+#ifdef __AVR__
+  char* heapHighWater = HeapEnd();
+  PaintFreeRam();
+#endif
+
+  Quality quality;
+  quality.Start();
+
+  uint32_t elapsed = 0;
+  for (int i = 0; i < k_steps; ++i)
+  {
+    uint32_t start = Cycles();
+    world.StepWith<Policy>(k_timeStep);
+    elapsed += Cycles() - start;
+
+#ifdef __AVR__
+    if (HeapEnd() > heapHighWater)
+      heapHighWater = HeapEnd();
+#endif
+    quality.Update(i);
+  }
+
+  out.print(name);
+  PrintPerStep(out, F(": "), elapsed);
+  out.println(F(" " CYCLE_UNIT " per step"));
+
+#if ARDUBOX2D_STATS
+  const WorldStats& s = World::stats;
+  PrintPerStep(out, F("    broad phase "), s.broadPhaseMicros);
+  PrintPerStep(out, F(", particles "), s.particleMicros);
+  PrintPerStep(out, F(", forces "), s.integrateForcesMicros);
+  PrintPerStep(out, F(", pre-step "), s.preStepMicros);
+  PrintPerStep(out, F(", iterations "), s.iterationsMicros);
+  PrintPerStep(out, F(", velocities "), s.integrateVelocitiesMicros);
+  out.println();
+#endif
+
+  out.print(F("    arena high water "));
+  out.print(world.arena.highWater);
+  out.print(F(" bytes, failed allocations "));
+  out.print(world.arena.failedAllocations);
+#ifdef __AVR__
+  out.print(F(", stack depth "));
+  out.print(StackDepth(heapHighWater));
+  out.print(F(" bytes, heap high water "));
+  out.print(heapHighWater - &__heap_start);
+  out.print(F(" bytes"));
+#endif
+  out.println();
+
+  quality.PrintTo(out, isStack);
+}
+
+// 1 / k by division and by Reciprocal over denominators from 1/8 to 64,
+// the range effective masses and time steps fall in.
+void TimeReciprocal(Print& out)
+{
+  const int k_count = 512;
+  volatile int16_t sink = 0;
+  uint16_t mismatches = 0;
+
+  uint32_t start = Cycles();
+  for (int i = 0; i < k_count; ++i)
+    sink = (1.0 / SQ7x8::fromInternal(32 + i * 31)).getInternal();
+  uint32_t divisionTime = Cycles() - start;
+
+  start = Cycles();
+  for (int i = 0; i < k_count; ++i)
+    sink = Reciprocal(SQ7x8::fromInternal(32 + i * 31)).getInternal();
+  uint32_t reciprocalTime = Cycles() - start;
+
+  for (int i = 0; i < k_count; ++i)
+  {
+    SQ7x8 k = SQ7x8::fromInternal(32 + i * 31);
+    if ((1.0 / k).getInternal() != Reciprocal(k).getInternal())
+      ++mismatches;
+  }
+  (void)sink;
+
+  out.print(F("  division: "));
+  out.print(divisionTime);
+  out.print(F(" " CYCLE_UNIT ", Reciprocal: "));
+  out.print(reciprocalTime);
+  out.print(F(" " CYCLE_UNIT " for "));
+  out.print(k_count);
+  out.print(F(", mismatches: "));
+  out.println(mismatches);
+}
+
+#define BENCHMARK_STRING(x) BENCHMARK_STRING_(x)
+#define BENCHMARK_STRING_(x) #x
+
+// The options that change results or cost, so that logs from different
+// builds say what they measured.
+void PrintConfig(Print& out)
+{
+  out.print(F("config: " BENCHMARK_STRING(ARDUBOX2D_SOLVER_POLICY)
+              ", mass cache " BENCHMARK_STRING(ARDUBOX2D_MASS_CACHE)
+              ", arena " BENCHMARK_STRING(ARDUBOX2D_ARENA_SIZE)
+              ", SAT batch " BENCHMARK_STRING(ARDUBOX2D_SAT_BATCH)
+              ", colored solver " BENCHMARK_STRING(ARDUBOX2D_COLORED_SOLVER)
+              ", incremental manifold " BENCHMARK_STRING(ARDUBOX2D_INCREMENTAL_MANIFOLD)
+              ", AVR MAC " BENCHMARK_STRING(ARDUBOX2D_AVR_MAC)
+              ", iterations "));
+  out.println(world.iterations);
+}
+
+void TimePiles(Print& out, const __FlashStringHelper* name)
+{
+  static const uint8_t pileSizes[] = {5, 10, 20};
+  for (uint8_t i = 0; i < sizeof(pileSizes); ++i)
+  {
+    out.print(name);
+    out.print(pileSizes[i]);
+    if (pileSizes[i] > ARDUBOX2D_BENCHMARK_MAX_BODIES)
+    {
+      out.print(F(": skipped, needs ARDUBOX2D_BENCHMARK_MAX_BODIES >= "));
+      out.print(pileSizes[i]);
+      out.println(F(" and a larger arena"));
+      continue;
+    }
+    TimeScene<DefaultSolverPolicy>(out, F(""), BuildPile, pileSizes[i]);
+  }
+}
+
+}
+
+void RunBenchmark(Print& out)
+{
+  StartCycleCounter();
+
+  PrintConfig(out);
+  out.println(F("1 / k"));
+  TimeReciprocal(out);
+
+  out.println(F("scenes, 120 steps each"));
+  TimeScene<DefaultSolverPolicy>(out, F("  demo 4"), BuildDemo4, 0);
+  TimeScene<DefaultSolverPolicy>(out, F("  stack of 5"), BuildStack, 5, true);
+  TimeScene<RuntimeSolverPolicy>(out, F("  stack of 5, runtime solver policy"), BuildStack, 5, true);
+
+  TimePiles(out, F("  pile of "));
+
+#if ARDUBOX2D_COLORED_SOLVER
+  // Throughput against convergence: the colored solver on the same piles.
+  world.coloredSolver = true;
+  TimePiles(out, F("  colored pile of "));
+  world.coloredSolver = false;
+#endif
+}
+
+void EndBenchmarkRun()
+{
+#ifdef __AVR__
+  // Sleeping with interrupts off ends a simavr run.
+  cli();
+  sleep_enable();
+  sleep_cpu();
+#endif
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+  On-device benchmark for the engine.
+
+  Enable with ARDUBOX2D_BENCHMARK in Config.h. setup() then runs RunBenchmark
+  over serial before starting the demo. Each scene is rebuilt from scratch for
+  every configuration, so runs are comparable. With ARDUBOX2D_CYCLE_COUNTER
+  times are in CPU cycles, and on AVR each scene also reports the deepest the
+  stack went and the heap's high water, found by painting free RAM.
+  Every scene ends with how far it is from rest, which with
+  ARDUBOX2D_COLORED_SOLVER compares the colored solver's piles against the
+  sequential ones. Off AVR it also ends with how far the bodies are from a
+  float run of the same scene (see Reference.h).
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Config.h"
+
+#if ARDUBOX2D_BENCHMARK
+
+class Print;
+
+void RunBenchmark(Print& out);
+
+// Halts the CPU, which ends a run under simavr. Does nothing off AVR.
+void EndBenchmarkRun();
+
+#endif
+
+#endif
@@ -1,52 +1,112 @@
-/*
-* Copyright (c) 2006-2007 Erin Catto http://www.gphysics.com
-*
-* Permission to use, copy, modify, distribute and sell this software
-* and its documentation for any purpose is hereby granted without fee,
-* provided that the above copyright notice appear in all copies.
-* Erin Catto makes no representations about the suitability 
-* of this software for any purpose.  
-* It is provided "as is" without express or implied warranty.
-* 
-* 
-  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
-  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
-  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
-    
-*/
-
-#ifndef BODY_H
-#define BODY_H
-
-#include "MathUtils.h"
-
-#include <FixedPoints.h>
-#include <FixedPointsCommon.h>
-#include <ArduinoSTL.h>
-struct Body
-{
-  Body();
-  void Set(const Vec2& w, SQ7x8 m);
-
-  void AddForce(const Vec2& f)
-  {
-    force += f;
-  }
-
-  Vec2 position;
-  SQ7x8 rotation;
-
-  Vec2 velocity;
-  SQ7x8 angularVelocity;
-
-  Vec2 force;
-  SQ7x8 torque;
-
-  Vec2 width;
-
-  SQ7x8 friction;
-  SQ7x8 mass, invMass;
-  SQ7x8 I, invI;
-};
-
-#endif
+/*
+* Copyright (c) 2006-2007 Erin Catto http://www.gphysics.com
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Erin Catto makes no representations about the suitability 
+* of this software for any purpose.  
+* It is provided "as is" without express or implied warranty.
+* 
+* 
+  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
+  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
+  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
+    
+*/
+
+#ifndef BODY_H
+#define BODY_H
+
+#include "MathUtils.h"
+
+#include <FixedPoints.h>
+#include <FixedPointsCommon.h>
+#include <ArduinoSTL.h>
+struct Arbiter;
+
+struct Body
+{
+  Body();
+  void Set(const Vec2& w, SQ7x8 m);
+
+  void AddForce(const Vec2& f)
+  {
+    force += f;
+  }
+
+  // Moving a body by hand: both mark its bounds and corners for a refresh.
+  void SetPosition(const Vec2& p)
+  {
+    position = p;
+    transformDirty = true;
+  }
+
+  void SetRotation(SQ7x8 angle)
+  {
+    rotation = angle;
+    transformDirty = true;
+  }
+
+  // Recomputes aabb from the current position and rotation. UpdateTransform
+  // also recomputes vertices and clears transformDirty.
+  void UpdateAABB();
+  void UpdateTransform();
+
+  // The corners for the current position and rotation, whether or not
+  // vertices is up to date.
+  void ComputeVertices(Vec2 out[4]) const;
+
+  Vec2 position;
+  SQ7x8 rotation;
+
+  Vec2 velocity;
+  SQ7x8 angularVelocity;
+
+  Vec2 force;
+  SQ7x8 torque;
+
+  Vec2 width;
+
+  // World-space bounds and corners, numbered as in Collide.cpp. World::Step
+  // refreshes them for the bodies it moved and for those moved with
+  // SetPosition or SetRotation.
+  AABB aabb;
+  Vec2 vertices[4];
+  bool transformDirty;
+
+  SQ7x8 friction;
+  SQ7x8 mass, invMass;
+  SQ7x8 I, invI;
+
+  // Collision filtering. Two bodies in the same non-zero group always collide
+  // (positive group) or never collide (negative group). Otherwise each body's
+  // category must be in the other's mask.
+  uint8_t categoryBits;
+  uint8_t maskBits;
+  int8_t groupIndex;
+
+  // A sensor reports overlaps in World::sensorOverlaps but gets no contacts.
+  bool isSensor;
+
+  // A kinematic body has infinite mass but is moved by its velocity. It
+  // pushes dynamic bodies and ignores static and other kinematic ones.
+  bool isKinematic;
+
+  // Kept by World: the body's slot in World::bodies, its simulation level of
+  // detail (World::LOD_FULL or LOD_REDUCED) and the head of the list of
+  // arbiters it takes part in.
+  uint8_t index;
+  uint8_t lod;
+  Arbiter* arbiterList;
+};
+
+inline bool ShouldCollide(const Body* a, const Body* b)
+{
+  if (a->groupIndex == b->groupIndex && a->groupIndex != 0)
+    return a->groupIndex > 0;
+
+  return (a->categoryBits & b->maskBits) != 0 && (b->categoryBits & a->maskBits) != 0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+  Fixed pool of bodies for World::Create and World::Destroy.
+
+  Free slots are chained through nextFree, so both Allocate and Free are
+  O(1) and nothing touches the heap. ARDUBOX2D_BODY_POOL_SIZE bodies are
+  reserved up front; bodies handed to World::Add are not pooled.
+*/
+
+#ifndef BODY_POOL_H
+#define BODY_POOL_H
+
+#include <stdint.h>
+
+#include "Body.h"
+
+#ifndef ARDUBOX2D_BODY_POOL_SIZE
+#define ARDUBOX2D_BODY_POOL_SIZE 6
+#endif
+
+struct BodyPool
+{
+  enum {SIZE = ARDUBOX2D_BODY_POOL_SIZE};
+  enum {NONE = 0xFF};
+
+  BodyPool() : firstFree(0)
+  {
+    for (uint8_t i = 0; i < SIZE; ++i)
+      nextFree[i] = i + 1 < SIZE ? i + 1 : NONE;
+  }
+
+  // Returns 0 when every slot is in use.
+  Body* Allocate()
+  {
+    if (firstFree == NONE)
+      return 0;
+
+    uint8_t i = firstFree;
+    firstFree = nextFree[i];
+    return slots + i;
+  }
+
+  void Free(Body* body)
+  {
+    uint8_t i = body - slots;
+    nextFree[i] = firstFree;
+    firstFree = i;
+  }
+
+  bool Owns(const Body* body) const
+  {
+    return body >= slots && body < slots + SIZE;
+  }
+
+  Body slots[SIZE];
+  uint8_t nextFree[SIZE];
+  uint8_t firstFree;
+};
+
+#endif
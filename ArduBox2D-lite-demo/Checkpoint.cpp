@@ -0,0 +1,461 @@
+/*
+  Cheap world checkpoints for rollback re-simulation. See Checkpoint.h.
+*/
+
+#include "Checkpoint.h"
+#include "World.h"
+#include "Body.h"
+
+#include <string.h>
+
+typedef std::map<ArbiterKey, Arbiter>::iterator ArbIter;
+typedef std::map<ArbiterKey, Arbiter>::const_iterator ArbConstIter;
+
+// Record layout, all values in native byte order:
+//   u16 frame, u16 size, u8 numBodies, u8 World::lodFrame, SQ7x8 lodTime
+//   bodies: full record  -> BODY_WORDS words per body
+//           delta record -> mask byte per body, then the masked words
+//   u16 numArbiters, then per arbiter: u8 index1, u8 index2, u8 numContacts,
+//   for a tile arbiter the run's row, column and length, per contact the
+//   feature id and Pn, Pt, Pnb, and with
+//   ARDUBOX2D_INCREMENTAL_MANIFOLD the arbiter's ManifoldCache.
+enum
+{
+  HEADER_SIZE = 8,
+  BODY_WORDS = 10,
+  FORCE_WORDS = 3,        // force.x, force.y and torque share mask bit 6
+  FORCE_BIT = 6,
+  LOD_BIT = 7,            // Body::lod, the last word
+  TILE_RUN_SIZE = 3,
+  CONTACT_SIZE = sizeof(FeaturePair) + 3 * sizeof(int16_t),
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+  MANIFOLD_SIZE = 4 + 4 * sizeof(int16_t) + 2 * sizeof(FeaturePair)
+#else
+  MANIFOLD_SIZE = 0
+#endif
+};
+
+namespace {
+
+inline uint16_t Get16(const uint8_t* p)
+{
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void Put16(uint8_t* p, uint16_t v)
+{
+  memcpy(p, &v, sizeof(v));
+}
+
+inline void PutFixed(uint8_t*& p, SQ7x8 v)
+{
+  Put16(p, v.getInternal());
+  p += 2;
+}
+
+inline SQ7x8 GetFixed(const uint8_t*& p)
+{
+  SQ7x8 v = SQ7x8::fromInternal(Get16(p));
+  p += 2;
+  return v;
+}
+
+// The body fields a checkpoint tracks, in record order.
+void GetWords(const Body* b, int16_t w[BODY_WORDS])
+{
+  w[0] = b->position.x.getInternal();
+  w[1] = b->position.y.getInternal();
+  w[2] = b->rotation.getInternal();
+  w[3] = b->velocity.x.getInternal();
+  w[4] = b->velocity.y.getInternal();
+  w[5] = b->angularVelocity.getInternal();
+  w[6] = b->force.x.getInternal();
+  w[7] = b->force.y.getInternal();
+  w[8] = b->torque.getInternal();
+  w[9] = b->lod;
+}
+
+void SetWords(Body* b, const int16_t w[BODY_WORDS])
+{
+  b->SetPosition(Vec2(SQ7x8::fromInternal(w[0]), SQ7x8::fromInternal(w[1])));
+  b->SetRotation(SQ7x8::fromInternal(w[2]));
+  b->velocity.x = SQ7x8::fromInternal(w[3]);
+  b->velocity.y = SQ7x8::fromInternal(w[4]);
+  b->angularVelocity = SQ7x8::fromInternal(w[5]);
+  b->force.x = SQ7x8::fromInternal(w[6]);
+  b->force.y = SQ7x8::fromInternal(w[7]);
+  b->torque = SQ7x8::fromInternal(w[8]);
+  b->lod = w[9];
+}
+
+uint16_t ArbitersSize(const World& world)
+{
+  uint16_t size = 2;
+  for (ArbConstIter arb = world.arbiters.begin(); arb != world.arbiters.end(); ++arb)
+  {
+    size += 3 + arb->second.numContacts * CONTACT_SIZE + MANIFOLD_SIZE;
+    if (arb->second.body2 >= World::TILE_INDEX)
+      size += TILE_RUN_SIZE;
+  }
+  return size;
+}
+
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+// Without the cached clip points a rolled-back pair would clip afresh where
+// the original run moved its points, and the replay would drift.
+void WriteManifold(const ManifoldCache& m, uint8_t*& p)
+{
+  *p++ = m.face;
+  *p++ = m.incidentEdge;
+  *p++ = m.separated;
+  *p++ = m.age;
+  for (int i = 0; i < 2; ++i)
+  {
+    PutFixed(p, m.localPoints[i].x);
+    PutFixed(p, m.localPoints[i].y);
+    memcpy(p, &m.features[i], sizeof(FeaturePair));
+    p += sizeof(FeaturePair);
+  }
+}
+
+void ReadManifold(ManifoldCache& m, const uint8_t*& p)
+{
+  m.face = *p++;
+  m.incidentEdge = *p++;
+  m.separated = *p++;
+  m.age = *p++;
+  for (int i = 0; i < 2; ++i)
+  {
+    m.localPoints[i].x = GetFixed(p);
+    m.localPoints[i].y = GetFixed(p);
+    memcpy(&m.features[i], p, sizeof(FeaturePair));
+    p += sizeof(FeaturePair);
+  }
+}
+#endif
+
+uint8_t* WriteArbiters(const World& world, uint8_t* p)
+{
+  Put16(p, world.arbiters.size());
+  p += 2;
+  for (ArbConstIter arb = world.arbiters.begin(); arb != world.arbiters.end(); ++arb)
+  {
+    const Arbiter& a = arb->second;
+    *p++ = a.body1;
+    *p++ = a.body2;
+    *p++ = a.numContacts;
+    if (a.body2 >= World::TILE_INDEX)
+    {
+      const TileRun& run = world.tileRuns[a.body2 - World::TILE_INDEX];
+      *p++ = run.row;
+      *p++ = run.column;
+      *p++ = run.length;
+    }
+    for (int i = 0; i < a.numContacts; ++i)
+    {
+      const Contact& c = a.contacts[i];
+      memcpy(p, &c.feature, sizeof(FeaturePair));
+      p += sizeof(FeaturePair);
+      PutFixed(p, c.Pn);
+      PutFixed(p, c.Pt);
+      PutFixed(p, c.Pnb);
+    }
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+    WriteManifold(a.manifold, p);
+#endif
+  }
+  return p;
+}
+
+void ReadContacts(Arbiter& a, const uint8_t*& p, uint8_t numContacts)
+{
+  a.numContacts = numContacts;
+  for (int i = 0; i < numContacts; ++i)
+  {
+    Contact& c = a.contacts[i];
+    memcpy(&c.feature, p, sizeof(FeaturePair));
+    p += sizeof(FeaturePair);
+    c.Pn = GetFixed(p);
+    c.Pt = GetFixed(p);
+    c.Pnb = GetFixed(p);
+  }
+}
+
+// Brings the arbiter map in line with a recorded list. Both are sorted by
+// ArbiterKey, so one merge pass updates surviving nodes in place.
+void ReadArbiters(World& world, const uint8_t* p)
+{
+  uint16_t numArbiters = Get16(p);
+  p += 2;
+  ArbIter it = world.arbiters.begin();
+
+  for (uint16_t n = 0; n < numArbiters; ++n)
+  {
+    ArbiterKey key(p[0], p[1]);
+    uint8_t numContacts = p[2];
+    p += 3;
+
+    // The slot may hold another run by now. Every arbiter left on it after
+    // the merge is one recorded here, so they all agree on the run, and
+    // InsertArbiter and EraseArbiter keep the refs.
+    if (key.body2 >= World::TILE_INDEX)
+    {
+      TileRun& run = world.tileRuns[key.body2 - World::TILE_INDEX];
+      run.row = p[0];
+      run.column = p[1];
+      run.length = p[2];
+      p += TILE_RUN_SIZE;
+    }
+
+    while (it != world.arbiters.end() && it->first < key)
+      world.EraseArbiter(it++);
+
+    if (it == world.arbiters.end() || key < it->first)
+      it = world.InsertArbiter(key);
+
+    ReadContacts(it->second, p, numContacts);
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+    ReadManifold(it->second.manifold, p);
+#endif
+    ++it;
+  }
+
+  while (it != world.arbiters.end())
+    world.EraseArbiter(it++);
+}
+
+uint16_t WriteFull(const World& world, uint16_t frame, uint8_t* record)
+{
+  uint8_t* p = record + HEADER_SIZE;
+  int16_t w[BODY_WORDS];
+  for (int i = 0; i < (int)world.bodies.size(); ++i)
+  {
+    GetWords(world.bodies[i], w);
+    memcpy(p, w, sizeof(w));
+    p += sizeof(w);
+  }
+  p = WriteArbiters(world, p);
+
+  uint16_t size = p - record;
+  Put16(record, frame);
+  Put16(record + 2, size);
+  record[4] = world.bodies.size();
+  record[5] = world.lodFrame;
+  Put16(record + 6, world.lodTime.getInternal());
+  return size;
+}
+
+// Encodes the full record as a delta against the world's current bodies: the
+// record's own value for every field that differs. Arbiters are copied as is.
+uint16_t WriteDelta(const uint8_t* full, const World& world, uint8_t* out)
+{
+  uint8_t numBodies = full[4];
+  const uint8_t* src = full + HEADER_SIZE;
+  uint8_t* p = out + HEADER_SIZE;
+
+  for (int i = 0; i < numBodies; ++i)
+  {
+    int16_t old[BODY_WORDS], cur[BODY_WORDS];
+    memcpy(old, src, sizeof(old));
+    src += sizeof(old);
+    GetWords(world.bodies[i], cur);
+
+    uint8_t* mask = p++;
+    *mask = 0;
+    for (int k = 0; k < FORCE_BIT; ++k)
+    {
+      if (old[k] != cur[k])
+      {
+        *mask |= 1 << k;
+        Put16(p, old[k]);
+        p += 2;
+      }
+    }
+    if (memcmp(old + FORCE_BIT, cur + FORCE_BIT, FORCE_WORDS * sizeof(int16_t)) != 0)
+    {
+      *mask |= 1 << FORCE_BIT;
+      memcpy(p, old + FORCE_BIT, FORCE_WORDS * sizeof(int16_t));
+      p += FORCE_WORDS * sizeof(int16_t);
+    }
+    if (old[BODY_WORDS - 1] != cur[BODY_WORDS - 1])
+    {
+      *mask |= 1 << LOD_BIT;
+      Put16(p, old[BODY_WORDS - 1]);
+      p += 2;
+    }
+  }
+
+  uint16_t arbitersSize = full + Get16(full + 2) - src;
+  memcpy(p, src, arbitersSize);
+  p += arbitersSize;
+
+  uint16_t size = p - out;
+  Put16(out, Get16(full));
+  Put16(out + 2, size);
+  out[4] = numBodies;
+  memcpy(out + 5, full + 5, HEADER_SIZE - 5);
+  return size;
+}
+
+// Applies a delta record to the bodies and returns its arbiter section.
+const uint8_t* ApplyDelta(const uint8_t* record, World& world)
+{
+  uint8_t numBodies = record[4];
+  const uint8_t* p = record + HEADER_SIZE;
+
+  for (int i = 0; i < numBodies; ++i)
+  {
+    uint8_t mask = *p++;
+    if (mask == 0)
+      continue;
+
+    int16_t w[BODY_WORDS];
+    GetWords(world.bodies[i], w);
+    for (int k = 0; k < FORCE_BIT; ++k)
+    {
+      if (mask & (1 << k))
+      {
+        w[k] = Get16(p);
+        p += 2;
+      }
+    }
+    if (mask & (1 << FORCE_BIT))
+    {
+      memcpy(w + FORCE_BIT, p, FORCE_WORDS * sizeof(int16_t));
+      p += FORCE_WORDS * sizeof(int16_t);
+    }
+    if (mask & (1 << LOD_BIT))
+    {
+      w[BODY_WORDS - 1] = Get16(p);
+      p += 2;
+    }
+    SetWords(world.bodies[i], w);
+  }
+
+  return p;
+}
+
+}
+
+CheckpointRing::CheckpointRing(uint8_t* buffer, uint16_t capacity, uint8_t maxCheckpoints)
+  : buffer(buffer), capacity(capacity), maxCheckpoints(maxCheckpoints)
+{
+  Clear();
+}
+
+void CheckpointRing::Clear()
+{
+  used = 0;
+  newestOffset = 0;
+  count = 0;
+}
+
+uint16_t CheckpointRing::Offset(int index) const
+{
+  uint16_t offset = 0;
+  for (int i = 0; i < index; ++i)
+    offset += Get16(buffer + offset + 2);
+  return offset;
+}
+
+int CheckpointRing::Find(uint16_t frame) const
+{
+  uint16_t offset = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    if (Get16(buffer + offset) == frame)
+      return i;
+    offset += Get16(buffer + offset + 2);
+  }
+  return -1;
+}
+
+void CheckpointRing::DropOldest()
+{
+  uint16_t size = Get16(buffer + 2);
+  memmove(buffer, buffer + size, used - size);
+  used -= size;
+  newestOffset -= size;
+  --count;
+}
+
+bool CheckpointRing::Save(const World& world, uint16_t frame)
+{
+  uint8_t numBodies = world.bodies.size();
+  uint16_t fullSize = HEADER_SIZE + numBodies * BODY_WORDS * sizeof(int16_t) + ArbitersSize(world);
+
+  if (count > 0)
+  {
+    const uint8_t* newest = buffer + newestOffset;
+    if (newest[4] != numBodies || (int16_t)(frame - Get16(newest)) <= 0)
+      Clear();
+  }
+
+  // The newest record shrinks into a delta at most numBodies bytes larger
+  // than itself; that delta is staged at the end of the buffer first.
+  while (count > 0)
+  {
+    uint16_t newestSize = Get16(buffer + newestOffset + 2);
+    uint16_t staged = used + newestSize + numBodies;
+    uint16_t finalSize = used + numBodies + fullSize;
+    if (count < maxCheckpoints && staged <= capacity && finalSize <= capacity)
+      break;
+
+    if (count == 1)
+      Clear();
+    else
+      DropOldest();
+  }
+
+  if (count > 0)
+  {
+    uint16_t size = WriteDelta(buffer + newestOffset, world, buffer + used);
+    memmove(buffer + newestOffset, buffer + used, size);
+    used = newestOffset + size;
+  }
+
+  if (used + fullSize > capacity)
+    return false;
+
+  newestOffset = used;
+  used += WriteFull(world, frame, buffer + used);
+  ++count;
+  return true;
+}
+
+bool CheckpointRing::Restore(World& world, uint16_t frame)
+{
+  int index = Find(frame);
+  if (index < 0 || buffer[newestOffset + 4] != world.bodies.size())
+    return false;
+
+  // Start from the newest (full) record...
+  const uint8_t* p = buffer + newestOffset + HEADER_SIZE;
+  for (int i = 0; i < (int)world.bodies.size(); ++i)
+  {
+    int16_t w[BODY_WORDS];
+    memcpy(w, p, sizeof(w));
+    p += sizeof(w);
+    SetWords(world.bodies[i], w);
+  }
+
+  // ...and step back through the deltas to the requested frame.
+  for (int i = count - 2; i >= index; --i)
+    p = ApplyDelta(buffer + Offset(i), world);
+
+  ReadArbiters(world, p);
+
+  const uint8_t* record = buffer + Offset(index);
+  world.lodFrame = record[5];
+  world.lodTime = SQ7x8::fromInternal(Get16(record + 6));
+
+  // The restored frame becomes the newest, full record.
+  used = Offset(index);
+  count = index;
+  newestOffset = used;
+  used += WriteFull(world, frame, buffer + used);
+  ++count;
+  return true;
+}
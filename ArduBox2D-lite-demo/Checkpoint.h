@@ -0,0 +1,61 @@
+/*
+  Cheap world checkpoints for rollback re-simulation.
+
+  A CheckpointRing keeps the last few frames of mutable world state in a
+  caller-owned byte buffer: each body's position, rotation, velocities,
+  pending force/torque and level of detail, where the world is in its LOD
+  interval, plus each arbiter's feature ids and accumulated impulses (and its
+  ManifoldCache with ARDUBOX2D_INCREMENTAL_MANIFOLD). Shapes, masses and
+  friction are assumed not to change between checkpoints.
+
+  The newest checkpoint is stored in full. Each older one only holds the body
+  fields that differ from the checkpoint after it (one mask byte per body, so a
+  resting body costs a single byte), together with its own arbiter list. Saving
+  turns the previous full record into such a delta, and the oldest record is
+  dropped when the ring is full, so neither operation has to replay history.
+  Restoring walks back from the newest record and then patches the existing
+  arbiter map in place, only inserting or erasing nodes for contacts that began
+  or ended in the rolled-back frames.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+struct World;
+
+struct CheckpointRing
+{
+  CheckpointRing(uint8_t* buffer, uint16_t capacity, uint8_t maxCheckpoints = 8);
+
+  void Clear();
+
+  // Records the world state at the given frame, which must be newer than the
+  // last checkpoint. Drops the oldest checkpoints to make room. Returns false
+  // if the buffer cannot hold even a single checkpoint.
+  bool Save(const World& world, uint16_t frame);
+
+  // Puts the world back into the state recorded at frame and forgets every
+  // newer checkpoint, so re-simulated frames can be saved again. Returns false
+  // if the frame is no longer in the ring.
+  bool Restore(World& world, uint16_t frame);
+
+  bool Has(uint16_t frame) const { return Find(frame) >= 0; }
+  uint8_t Count() const { return count; }
+  uint16_t BytesUsed() const { return used; }
+
+  uint8_t* buffer;
+  uint16_t capacity;
+  uint16_t used;
+  uint16_t newestOffset;
+  uint8_t count;
+  uint8_t maxCheckpoints;
+
+private:
+  int Find(uint16_t frame) const;
+  uint16_t Offset(int index) const;
+  void DropOldest();
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+  Compile-time options for the ArduBox2D-lite engine.
+
+  The Arduino IDE has no per-sketch compiler flags, so every option lives here
+  behind an #ifndef and can be flipped by editing the default below (or by
+  passing -D on a host build). Options that are off cost nothing in flash or RAM.
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Collect call counts and per-phase timings in World::stats (see Stats.h).
+#ifndef ARDUBOX2D_STATS
+#define ARDUBOX2D_STATS 0
+#endif
+
+// Solver switches. DefaultSolverPolicy fixes accumulated impulses, warm
+// starting and position correction on at compile time, so the branches for
+// the other settings are never built. RuntimeSolverPolicy reads the
+// World::accumulateImpulses/warmStarting/positionCorrection flags instead,
+// which is slower but lets you toggle them while debugging.
+#ifndef ARDUBOX2D_SOLVER_POLICY
+#define ARDUBOX2D_SOLVER_POLICY DefaultSolverPolicy
+#endif
+
+// Keep each contact point's effective masses between steps and reuse them
+// while their denominators are unchanged, skipping up to two reciprocals per
+// point (see Arbiter::PreStep). Results are identical either way. Costs 8
+// bytes of RAM per contact point, doubling a Contact, and only exact matches
+// hit, so it is off unless stats.massCacheHits and the benchmark on the
+// device show that it pays on your scenes.
+#ifndef ARDUBOX2D_MASS_CACHE
+#define ARDUBOX2D_MASS_CACHE 0
+#endif
+
+// AVR only: MulAdd/MulSub in hand-written assembly (see MathUtils.h) instead
+// of the portable C++. Not yet built with avr-gcc: the instruction sequence
+// was only checked against the portable version in an instruction-level
+// model, and its operands take all of r16-r23, which may not allocate at
+// every optimization level. Leave it off until it builds and matches on the
+// device.
+#ifndef ARDUBOX2D_AVR_MAC
+#define ARDUBOX2D_AVR_MAC 0
+#endif
+
+// Host builds only: BroadPhase runs Collide()'s face separation tests for 8
+// pairs at a time with SSE2 and calls Collide() only for the pairs that are
+// not separated (see SatBatch.h). Results are identical to the scalar path.
+// Has no effect where SSE2 is missing, which includes AVR.
+#ifndef ARDUBOX2D_SAT_BATCH
+#define ARDUBOX2D_SAT_BATCH 1
+#endif
+
+#if ARDUBOX2D_SAT_BATCH && !defined(__SSE2__)
+#undef ARDUBOX2D_SAT_BATCH
+#define ARDUBOX2D_SAT_BATCH 0
+#endif
+
+// Carry each arbiter's clip points from step to step and only clip again
+// when the reference face, the incident edge or a point's side of the face
+// changes, or every this many steps (see UpdateManifold in Collide.cpp). 0
+// clips every pair every step. Resting stacks skip most of the clipping, but
+// contacts on sliding boxes are approximate between clips, and replays from a
+// snapshot are no longer bit-exact because snapshots do not keep the cached
+// points. Checkpoints do, at 16 more bytes per arbiter, so rollback stays
+// exact. Costs 16 bytes of RAM per arbiter.
+#ifndef ARDUBOX2D_INCREMENTAL_MANIFOLD
+#define ARDUBOX2D_INCREMENTAL_MANIFOLD 0
+#endif
+
+// Host builds: adds World::coloredSolver, which splits the step's arbiters
+// into colors, no two arbiters of a color sharing a dynamic body, and runs the
+// solver iterations color by color. Built with OpenMP (-fopenmp), and with
+// ARDUBOX2D_STATS off, each large color is solved across threads. Results
+// differ from the sequential loop, which visits arbiters in another order, but
+// not between thread counts. Costs a vector of arbiter pointers per world.
+#ifndef ARDUBOX2D_COLORED_SOLVER
+#define ARDUBOX2D_COLORED_SOLVER 0
+#endif
+
+// Have the demo draw from a RenderBuffer (see Render.h) instead of from the
+// bodies. It costs 44 bytes of RAM per body, which is a lot on the
+// ATmega32u4 next to the 1KB screen buffer, so it is off by default. Without
+// it, the demo still splits each step around the drawing.
+#ifndef ARDUBOX2D_RENDER_BUFFER
+#define ARDUBOX2D_RENDER_BUFFER 0
+#endif
+
+// Run RunBenchmark() over serial from setup() instead of going straight to
+// the demo (see Benchmark.h). 1 prints over USB once the serial monitor is
+// open. 2 is for running under simavr, which has no USB: the benchmark runs
+// before the display is set up, prints on Serial1 and halts the CPU when done.
+#ifndef ARDUBOX2D_BENCHMARK
+#define ARDUBOX2D_BENCHMARK 0
+#endif
+
+// Bodies in the benchmark's largest pile: piles of 5, 10 and 20 are run up to
+// this size, and larger ones are listed as skipped. A pile of 20, with the
+// ARDUBOX2D_ARENA_SIZE it needs, does not fit in the ATmega32u4's RAM next to
+// the demo.
+#ifndef ARDUBOX2D_BENCHMARK_MAX_BODIES
+#define ARDUBOX2D_BENCHMARK_MAX_BODIES 10
+#endif
+
+// Count CPU cycles with Timer1 for the stats timers and the benchmark
+// instead of microseconds (AVR only, see CycleCounter.h).
+#ifndef ARDUBOX2D_CYCLE_COUNTER
+#define ARDUBOX2D_CYCLE_COUNTER 0
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+/*
+  CPU cycle counter. See CycleCounter.h.
+*/
+
+#include "CycleCounter.h"
+
+#if ARDUBOX2D_CYCLE_COUNTER && defined(__AVR__)
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+namespace {
+volatile uint16_t timer1Overflows;
+}
+
+ISR(TIMER1_OVF_vect)
+{
+  ++timer1Overflows;
+}
+
+void StartCycleCounter()
+{
+  uint8_t sreg = SREG;
+  cli();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10); // no prescaler
+  TCNT1 = 0;
+  timer1Overflows = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+  SREG = sreg;
+}
+
+uint32_t Cycles()
+{
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = TCNT1;
+  uint16_t overflows = timer1Overflows;
+  // An overflow that happened since interrupts went off is still pending.
+  if ((TIFR1 & _BV(TOV1)) && count < 0x8000)
+    ++overflows;
+  SREG = sreg;
+  return (static_cast<uint32_t>(overflows) << 16) | count;
+}
+
+#endif
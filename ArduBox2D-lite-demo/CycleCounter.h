@@ -0,0 +1,36 @@
+/*
+  CPU cycle counter for the stats timers and the benchmark.
+
+  Enable with ARDUBOX2D_CYCLE_COUNTER in Config.h (AVR only). Timer1 then
+  runs at the CPU clock and an overflow interrupt extends it to 32 bits, so
+  timings are in cycles, exact on the board and under a cycle-accurate
+  emulator such as simavr. Otherwise Cycles() falls back to micros().
+*/
+
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include <stdint.h>
+
+#include "Config.h"
+
+#if ARDUBOX2D_CYCLE_COUNTER && defined(__AVR__)
+
+// Takes over Timer1 and restarts the count at zero.
+void StartCycleCounter();
+uint32_t Cycles();
+
+#define CYCLE_UNIT "cycles"
+
+#else
+
+#include <Arduino.h>
+
+inline void StartCycleCounter() {}
+inline uint32_t Cycles() { return micros(); }
+
+#define CYCLE_UNIT "us"
+
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+/*
+  Lightweight particles for debris and effects.
+
+  A particle is a point with a velocity: no mass, no rotation and no arbiter.
+  World::Step moves the particles handed to World::SetParticles under gravity
+  and bounces them off bodies and the tilemap, pushing each one out through
+  the nearest face and reflecting its velocity with particleRestitution.
+  Particles never push back on bodies and do not collide with each other, so
+  a hundred of them cost about as much as a few body pairs.
+*/
+
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
+#include "MathUtils.h"
+
+struct Particle
+{
+  Vec2 position;
+  Vec2 velocity;
+};
+
+#endif
@@ -0,0 +1,71 @@
+/*
+  Fixed-point reciprocal without a division. See Reciprocal.h.
+*/
+
+#include "Reciprocal.h"
+
+#include <Arduino.h>
+
+namespace {
+
+// 2^32 / m - 2^16 at the middle of each of 32 equal steps of m in
+// [2^15, 2^16).
+const uint16_t reciprocalSeeds[32] PROGMEM =
+{
+  63520, 59667, 56038, 52613, 49376, 46312, 43407, 40649,
+  38027, 35532, 33154, 30885, 28718, 26647, 24664, 22765,
+  20944, 19197, 17520, 15907, 14356, 12862, 11424, 10037,
+  8699, 7408, 6162, 4957, 3791, 2664, 1573, 516
+};
+
+}
+
+SQ7x8 Reciprocal(SQ7x8 x)
+{
+  int16_t raw = x.getInternal();
+  if (raw == 0)
+    return SQ7x8::fromInternal(0x7FFF);
+
+  bool negative = raw < 0;
+  uint16_t k = negative ? -static_cast<uint16_t>(raw) : raw;
+
+  // Normalise k to m = k << shift in [2^15, 2^16).
+  uint16_t m = k;
+  uint8_t shift = 0;
+  if (!(m & 0xFF00))
+  {
+    m <<= 8;
+    shift = 8;
+  }
+  while (!(m & 0x8000))
+  {
+    m <<= 1;
+    ++shift;
+  }
+
+  // r ~ 2^32 / m, good to 6 bits from the table and 12 after the Newton
+  // step r += r * (2^32 - m * r) / 2^32. The error term is small, so the
+  // product may wrap.
+  uint32_t r = 0x10000UL + pgm_read_word(&reciprocalSeeds[(m >> 10) & 0x1F]);
+  int32_t e = static_cast<int32_t>(0UL - m * r);
+  r += (static_cast<int32_t>(r >> 1) * (e >> 12)) >> 19;
+
+  // 2^16 / k = (2^32 / m) >> (16 - shift). Step to the truncated quotient
+  // the division would give: at most one step unless |x| < 1/16.
+  uint32_t q = r >> (16 - shift);
+  int32_t remainder = 0x10000L - static_cast<int32_t>(q * k);
+  while (remainder < 0)
+  {
+    --q;
+    remainder += k;
+  }
+  while (remainder >= static_cast<int32_t>(k))
+  {
+    ++q;
+    remainder -= k;
+  }
+
+  // Wraps like the division does for |x| below 2 / 256.
+  int16_t result = static_cast<int16_t>(q);
+  return SQ7x8::fromInternal(negative ? -result : result);
+}
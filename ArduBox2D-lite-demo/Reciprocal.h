@@ -0,0 +1,17 @@
+/*
+  Fixed-point reciprocal without a division.
+
+  1.0 / x on SQ7x8 is a 32-by-16-bit software division on AVR. Reciprocal
+  gives the same result, bit for bit, from a table seed, one Newton step and
+  a multiply to correct the last bit. Zero returns the largest SQ7x8.
+*/
+
+#ifndef RECIPROCAL_H
+#define RECIPROCAL_H
+
+#include <FixedPoints.h>
+#include <FixedPointsCommon.h>
+
+SQ7x8 Reciprocal(SQ7x8 x);
+
+#endif
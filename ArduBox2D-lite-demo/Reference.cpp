@@ -0,0 +1,493 @@
+/*
+  Float reference simulation, see Reference.h. Collide() and the solver
+  follow Collide.cpp and Arbiter.cpp line for line, minus the fixed point.
+*/
+
+#include "Reference.h"
+
+#if ARDUBOX2D_BENCHMARK && !defined(__AVR__)
+
+#include <math.h>
+
+#include "Body.h"
+#include "World.h"
+
+namespace {
+
+RefVec2 operator+(const RefVec2& a, const RefVec2& b) { return RefVec2(a.x + b.x, a.y + b.y); }
+RefVec2 operator-(const RefVec2& a, const RefVec2& b) { return RefVec2(a.x - b.x, a.y - b.y); }
+RefVec2 operator-(const RefVec2& a) { return RefVec2(-a.x, -a.y); }
+RefVec2 operator*(float s, const RefVec2& v) { return RefVec2(s * v.x, s * v.y); }
+
+float Dot(const RefVec2& a, const RefVec2& b) { return a.x * b.x + a.y * b.y; }
+float Cross(const RefVec2& a, const RefVec2& b) { return a.x * b.y - a.y * b.x; }
+RefVec2 Cross(const RefVec2& a, float s) { return RefVec2(s * a.y, -s * a.x); }
+RefVec2 Cross(float s, const RefVec2& a) { return RefVec2(-s * a.y, s * a.x); }
+RefVec2 Abs(const RefVec2& a) { return RefVec2(fabsf(a.x), fabsf(a.y)); }
+float Sign(float x) { return x < 0.0f ? -1.0f : 1.0f; }
+
+struct RefMat22
+{
+  RefMat22() {}
+  RefMat22(const RefVec2& col1, const RefVec2& col2) : col1(col1), col2(col2) {}
+  explicit RefMat22(float angle)
+  {
+    float c = cosf(angle), s = sinf(angle);
+    col1.x = c; col2.x = -s;
+    col1.y = s; col2.y = c;
+  }
+
+  RefMat22 Transpose() const { return RefMat22(RefVec2(col1.x, col2.x), RefVec2(col1.y, col2.y)); }
+
+  RefVec2 col1, col2;
+};
+
+RefVec2 operator*(const RefMat22& A, const RefVec2& v)
+{
+  return RefVec2(A.col1.x * v.x + A.col2.x * v.y, A.col1.y * v.x + A.col2.y * v.y);
+}
+
+RefMat22 operator*(const RefMat22& A, const RefMat22& B) { return RefMat22(A * B.col1, A * B.col2); }
+RefMat22 Abs(const RefMat22& A) { return RefMat22(Abs(A.col1), Abs(A.col2)); }
+
+// Box vertex and edge numbering, as in Collide.cpp.
+enum Axis
+{
+  FACE_A_X,
+  FACE_A_Y,
+  FACE_B_X,
+  FACE_B_Y
+};
+
+enum EdgeNumbers
+{
+  NO_EDGE = 0,
+  EDGE1,
+  EDGE2,
+  EDGE3,
+  EDGE4
+};
+
+struct ClipVertex
+{
+  ClipVertex() { fp.value = 0; }
+  RefVec2 v;
+  FeaturePair fp;
+};
+
+int ClipSegmentToLine(ClipVertex vOut[2], const ClipVertex vIn[2], const RefVec2& normal, float offset, char clipEdge)
+{
+  int numOut = 0;
+
+  float distance0 = Dot(normal, vIn[0].v) - offset;
+  float distance1 = Dot(normal, vIn[1].v) - offset;
+
+  if (distance0 <= 0.0f) vOut[numOut++] = vIn[0];
+  if (distance1 <= 0.0f) vOut[numOut++] = vIn[1];
+
+  if (distance0 * distance1 < 0.0f)
+  {
+    float interp = distance0 / (distance0 - distance1);
+    vOut[numOut].v = vIn[0].v + interp * (vIn[1].v - vIn[0].v);
+    if (distance0 > 0.0f)
+    {
+      vOut[numOut].fp = vIn[0].fp;
+      vOut[numOut].fp.e.inEdge1 = clipEdge;
+      vOut[numOut].fp.e.inEdge2 = NO_EDGE;
+    }
+    else
+    {
+      vOut[numOut].fp = vIn[1].fp;
+      vOut[numOut].fp.e.outEdge1 = clipEdge;
+      vOut[numOut].fp.e.outEdge2 = NO_EDGE;
+    }
+    ++numOut;
+  }
+
+  return numOut;
+}
+
+void ComputeIncidentEdge(ClipVertex c[2], const RefVec2& h, const RefVec2& pos, const RefMat22& Rot, const RefVec2& normal)
+{
+  RefVec2 n = -(Rot.Transpose() * normal);
+  RefVec2 nAbs = Abs(n);
+
+  // Same corners as Body::vertices: 0 = (+x, +y), then counterclockwise.
+  int first;
+  if (nAbs.x > nAbs.y)
+    first = Sign(n.x) > 0.0f ? 3 : 1;
+  else
+    first = Sign(n.y) > 0.0f ? 0 : 2;
+
+  static const float signs[4][2] = {{1, 1}, {-1, 1}, {-1, -1}, {1, -1}};
+  for (int i = 0; i < 2; ++i)
+  {
+    int k = (first + i) & 3;
+    c[i].v = pos + Rot * RefVec2(signs[k][0] * h.x, signs[k][1] * h.y);
+  }
+  c[0].fp.e.inEdge2 = ((first + 3) & 3) + 1;
+  c[0].fp.e.outEdge2 = first + 1;
+  c[1].fp.e.inEdge2 = first + 1;
+  c[1].fp.e.outEdge2 = ((first + 1) & 3) + 1;
+}
+
+int Collide(RefContact* contacts, const RefBody* bodyA, const RefBody* bodyB)
+{
+  RefVec2 hA = 0.5f * bodyA->width;
+  RefVec2 hB = 0.5f * bodyB->width;
+
+  RefVec2 posA = bodyA->position;
+  RefVec2 posB = bodyB->position;
+
+  RefMat22 RotA(bodyA->rotation), RotB(bodyB->rotation);
+  RefMat22 RotAT = RotA.Transpose();
+  RefMat22 RotBT = RotB.Transpose();
+
+  RefVec2 dp = posB - posA;
+  RefVec2 dA = RotAT * dp;
+  RefVec2 dB = RotBT * dp;
+
+  RefMat22 C = RotAT * RotB;
+  RefMat22 absC = Abs(C);
+  RefMat22 absCT = absC.Transpose();
+
+  RefVec2 faceA = Abs(dA) - hA - absC * hB;
+  if (faceA.x > 0.0f || faceA.y > 0.0f)
+    return 0;
+
+  RefVec2 faceB = Abs(dB) - absCT * hA - hB;
+  if (faceB.x > 0.0f || faceB.y > 0.0f)
+    return 0;
+
+  Axis axis = FACE_A_X;
+  float separation = faceA.x;
+  RefVec2 normal = dA.x > 0.0f ? RotA.col1 : -RotA.col1;
+
+  const float relativeTol = 0.95f;
+  const float absoluteTol = 0.01f;
+
+  if (faceA.y > relativeTol * separation + absoluteTol * hA.y)
+  {
+    axis = FACE_A_Y;
+    separation = faceA.y;
+    normal = dA.y > 0.0f ? RotA.col2 : -RotA.col2;
+  }
+
+  if (faceB.x > relativeTol * separation + absoluteTol * hB.x)
+  {
+    axis = FACE_B_X;
+    separation = faceB.x;
+    normal = dB.x > 0.0f ? RotB.col1 : -RotB.col1;
+  }
+
+  if (faceB.y > relativeTol * separation + absoluteTol * hB.y)
+  {
+    axis = FACE_B_Y;
+    separation = faceB.y;
+    normal = dB.y > 0.0f ? RotB.col2 : -RotB.col2;
+  }
+
+  RefVec2 frontNormal, sideNormal;
+  ClipVertex incidentEdge[2];
+  float front, negSide, posSide;
+  char negEdge, posEdge;
+
+  switch (axis)
+  {
+  case FACE_A_X:
+    {
+      frontNormal = normal;
+      front = Dot(posA, frontNormal) + hA.x;
+      sideNormal = RotA.col2;
+      float side = Dot(posA, sideNormal);
+      negSide = -side + hA.y;
+      posSide =  side + hA.y;
+      negEdge = EDGE3;
+      posEdge = EDGE1;
+      ComputeIncidentEdge(incidentEdge, hB, posB, RotB, frontNormal);
+    }
+    break;
+
+  case FACE_A_Y:
+    {
+      frontNormal = normal;
+      front = Dot(posA, frontNormal) + hA.y;
+      sideNormal = RotA.col1;
+      float side = Dot(posA, sideNormal);
+      negSide = -side + hA.x;
+      posSide =  side + hA.x;
+      negEdge = EDGE2;
+      posEdge = EDGE4;
+      ComputeIncidentEdge(incidentEdge, hB, posB, RotB, frontNormal);
+    }
+    break;
+
+  case FACE_B_X:
+    {
+      frontNormal = -normal;
+      front = Dot(posB, frontNormal) + hB.x;
+      sideNormal = RotB.col2;
+      float side = Dot(posB, sideNormal);
+      negSide = -side + hB.y;
+      posSide =  side + hB.y;
+      negEdge = EDGE3;
+      posEdge = EDGE1;
+      ComputeIncidentEdge(incidentEdge, hA, posA, RotA, frontNormal);
+    }
+    break;
+
+  default:
+    {
+      frontNormal = -normal;
+      front = Dot(posB, frontNormal) + hB.y;
+      sideNormal = RotB.col1;
+      float side = Dot(posB, sideNormal);
+      negSide = -side + hB.x;
+      posSide =  side + hB.x;
+      negEdge = EDGE2;
+      posEdge = EDGE4;
+      ComputeIncidentEdge(incidentEdge, hA, posA, RotA, frontNormal);
+    }
+    break;
+  }
+
+  ClipVertex clipPoints1[2], clipPoints2[2];
+  if (ClipSegmentToLine(clipPoints1, incidentEdge, -sideNormal, negSide, negEdge) < 2)
+    return 0;
+  if (ClipSegmentToLine(clipPoints2, clipPoints1, sideNormal, posSide, posEdge) < 2)
+    return 0;
+
+  int numContacts = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    float sep = Dot(frontNormal, clipPoints2[i].v) - front;
+    if (sep <= 0.0f)
+    {
+      RefContact& c = contacts[numContacts++];
+      c.separation = sep;
+      c.normal = normal;
+      c.position = clipPoints2[i].v - sep * frontNormal;
+      c.feature = clipPoints2[i].fp;
+      if (axis == FACE_B_X || axis == FACE_B_Y)
+        Flip(c.feature);
+    }
+  }
+  return numContacts;
+}
+
+void Update(RefArbiter& arb, RefContact* newContacts, int numNewContacts)
+{
+  for (int i = 0; i < numNewContacts; ++i)
+  {
+    RefContact& c = newContacts[i];
+    c.Pn = c.Pt = c.Pnb = 0.0f;
+    for (int j = 0; j < arb.numContacts; ++j)
+    {
+      const RefContact& old = arb.contacts[j];
+      if (c.feature.value == old.feature.value)
+      {
+        c.Pn = old.Pn;
+        c.Pt = old.Pt;
+        c.Pnb = old.Pnb;
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < numNewContacts; ++i)
+    arb.contacts[i] = newContacts[i];
+  arb.numContacts = numNewContacts;
+}
+
+void PreStep(RefArbiter& arb, float inv_dt)
+{
+  const float k_allowedPenetration = 0.01f;
+  const float k_biasFactor = 0.2f;
+
+  RefBody* b1 = arb.body1;
+  RefBody* b2 = arb.body2;
+
+  for (int i = 0; i < arb.numContacts; ++i)
+  {
+    RefContact& c = arb.contacts[i];
+
+    c.r1 = c.position - b1->position;
+    c.r2 = c.position - b2->position;
+
+    float rn1 = Dot(c.r1, c.normal);
+    float rn2 = Dot(c.r2, c.normal);
+    float kNormal = b1->invMass + b2->invMass;
+    kNormal += b1->invI * (Dot(c.r1, c.r1) - rn1 * rn1) + b2->invI * (Dot(c.r2, c.r2) - rn2 * rn2);
+    c.massNormal = 1.0f / kNormal;
+
+    RefVec2 tangent = Cross(c.normal, 1.0f);
+    float rt1 = Dot(c.r1, tangent);
+    float rt2 = Dot(c.r2, tangent);
+    float kTangent = b1->invMass + b2->invMass;
+    kTangent += b1->invI * (Dot(c.r1, c.r1) - rt1 * rt1) + b2->invI * (Dot(c.r2, c.r2) - rt2 * rt2);
+    c.massTangent = 1.0f / kTangent;
+
+    c.bias = -k_biasFactor * inv_dt * fminf(0.0f, c.separation + k_allowedPenetration);
+
+    RefVec2 P = c.Pn * c.normal + c.Pt * tangent;
+
+    b1->velocity = b1->velocity - b1->invMass * P;
+    b1->angularVelocity -= b1->invI * Cross(c.r1, P);
+
+    b2->velocity = b2->velocity + b2->invMass * P;
+    b2->angularVelocity += b2->invI * Cross(c.r2, P);
+  }
+}
+
+void ApplyImpulse(RefArbiter& arb)
+{
+  RefBody* b1 = arb.body1;
+  RefBody* b2 = arb.body2;
+
+  for (int i = 0; i < arb.numContacts; ++i)
+  {
+    RefContact& c = arb.contacts[i];
+
+    RefVec2 dv = b2->velocity + Cross(b2->angularVelocity, c.r2) - b1->velocity - Cross(b1->angularVelocity, c.r1);
+    float vn = Dot(dv, c.normal);
+    float dPn = c.massNormal * (-vn + c.bias);
+
+    float Pn0 = c.Pn;
+    c.Pn = fmaxf(Pn0 + dPn, 0.0f);
+    dPn = c.Pn - Pn0;
+
+    RefVec2 Pn = dPn * c.normal;
+    b1->velocity = b1->velocity - b1->invMass * Pn;
+    b1->angularVelocity -= b1->invI * Cross(c.r1, Pn);
+    b2->velocity = b2->velocity + b2->invMass * Pn;
+    b2->angularVelocity += b2->invI * Cross(c.r2, Pn);
+
+    dv = b2->velocity + Cross(b2->angularVelocity, c.r2) - b1->velocity - Cross(b1->angularVelocity, c.r1);
+    RefVec2 tangent = Cross(c.normal, 1.0f);
+    float vt = Dot(dv, tangent);
+    float dPt = c.massTangent * (-vt);
+
+    float maxPt = arb.friction * c.Pn;
+    float Pt0 = c.Pt;
+    c.Pt = fmaxf(-maxPt, fminf(Pt0 + dPt, maxPt));
+    dPt = c.Pt - Pt0;
+
+    RefVec2 Pt = dPt * tangent;
+    b1->velocity = b1->velocity - b1->invMass * Pt;
+    b1->angularVelocity -= b1->invI * Cross(c.r1, Pt);
+    b2->velocity = b2->velocity + b2->invMass * Pt;
+    b2->angularVelocity += b2->invI * Cross(c.r2, Pt);
+  }
+}
+
+RefBody Mirror(const Body* b)
+{
+  RefBody r;
+  r.position = RefVec2(static_cast<float>(b->position.x), static_cast<float>(b->position.y));
+  r.rotation = static_cast<float>(b->rotation);
+  r.velocity = RefVec2(static_cast<float>(b->velocity.x), static_cast<float>(b->velocity.y));
+  r.angularVelocity = static_cast<float>(b->angularVelocity);
+  r.width = RefVec2(static_cast<float>(b->width.x), static_cast<float>(b->width.y));
+  r.friction = static_cast<float>(b->friction);
+  r.index = b->index;
+
+  // From the mass, as Body::Set does, rather than the rounded inverses.
+  if (b->invMass == 0.0)
+  {
+    r.invMass = 0.0f;
+    r.invI = 0.0f;
+  }
+  else
+  {
+    float m = static_cast<float>(b->mass);
+    r.invMass = 1.0f / m;
+    r.invI = 12.0f / (m * (r.width.x * r.width.x + r.width.y * r.width.y));
+  }
+  return r;
+}
+
+}
+
+void ReferenceWorld::Load(const World& world)
+{
+  gravity = RefVec2(static_cast<float>(world.gravity.x), static_cast<float>(world.gravity.y));
+  iterations = world.iterations;
+  numDynamic = world.bodies.size();
+
+  bodies.clear();
+  arbiters.clear();
+  bodies.reserve(world.bodies.size() + world.staticBodies.size());
+  for (int i = 0; i < (int)world.bodies.size(); ++i)
+    bodies.push_back(Mirror(world.bodies[i]));
+  for (int i = 0; i < (int)world.staticBodies.size(); ++i)
+    bodies.push_back(Mirror(world.staticBodies[i]));
+}
+
+// Keys as in World::arbiters, so the solver visits pairs in the same order.
+void ReferenceWorld::BroadPhase()
+{
+  for (int i = 0; i < numDynamic; ++i)
+  {
+    for (int j = i + 1; j < (int)bodies.size(); ++j)
+    {
+      RefBody* bi = &bodies[i];
+      RefBody* bj = &bodies[j];
+      uint16_t key = bi->index << 8 | bj->index;
+
+      RefContact newContacts[Arbiter::MAX_POINTS];
+      int numNewContacts = Collide(newContacts, bi, bj);
+
+      if (numNewContacts > 0)
+      {
+        std::map<uint16_t, RefArbiter>::iterator iter = arbiters.find(key);
+        if (iter == arbiters.end())
+        {
+          RefArbiter arb;
+          arb.numContacts = 0;
+          arb.body1 = bi;
+          arb.body2 = bj;
+          arb.friction = sqrtf(bi->friction * bj->friction);
+          iter = arbiters.insert(std::make_pair(key, arb)).first;
+        }
+        Update(iter->second, newContacts, numNewContacts);
+      }
+      else
+      {
+        arbiters.erase(key);
+      }
+    }
+  }
+}
+
+void ReferenceWorld::Step(float dt)
+{
+  float inv_dt = dt > 0.0f ? 1.0f / dt : 0.0f;
+
+  BroadPhase();
+
+  for (int i = 0; i < numDynamic; ++i)
+  {
+    RefBody& b = bodies[i];
+    if (b.invMass == 0.0f)
+      continue;
+    b.velocity = b.velocity + dt * gravity;
+  }
+
+  for (std::map<uint16_t, RefArbiter>::iterator arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+    PreStep(arb->second, inv_dt);
+
+  for (int n = 0; n < iterations; ++n)
+  {
+    for (std::map<uint16_t, RefArbiter>::iterator arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+      ApplyImpulse(arb->second);
+  }
+
+  for (int i = 0; i < numDynamic; ++i)
+  {
+    RefBody& b = bodies[i];
+    b.position = b.position + dt * b.velocity;
+    b.rotation += dt * b.angularVelocity;
+  }
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+  Float reference simulation for the benchmark, host builds only.
+
+  A copy of the engine's step in float: the same box-box Collide(), warm
+  started solver with accumulated impulses and position correction, and
+  arbiters visited in the same key order. RunBenchmark() copies each scene's
+  starting state into a ReferenceWorld, steps both side by side and reports
+  how far the SQ7x8 bodies end up from the float ones. Covers what the
+  benchmark scenes use: dynamic and static boxes, with no filtering,
+  sensors, kinematic bodies, tilemaps, particles or level of detail.
+  Compiled only with ARDUBOX2D_BENCHMARK off AVR, which has neither the RAM
+  nor the time for it.
+*/
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include "Config.h"
+
+#if ARDUBOX2D_BENCHMARK && !defined(__AVR__)
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include "Arbiter.h"
+
+struct World;
+
+struct RefVec2
+{
+  RefVec2() : x(0.0f), y(0.0f) {}
+  RefVec2(float x, float y) : x(x), y(y) {}
+
+  float x, y;
+};
+
+struct RefBody
+{
+  RefVec2 position;
+  float rotation;
+  RefVec2 velocity;
+  float angularVelocity;
+  RefVec2 width;
+  float friction;
+  float invMass, invI;
+  uint8_t index;  // Body::index of the body it mirrors
+};
+
+struct RefContact
+{
+  RefVec2 position;
+  RefVec2 normal;
+  RefVec2 r1, r2;
+  float separation;
+  float Pn, Pt, Pnb;
+  float massNormal, massTangent;
+  float bias;
+  FeaturePair feature;
+};
+
+struct RefArbiter
+{
+  RefContact contacts[Arbiter::MAX_POINTS];
+  int numContacts;
+  RefBody* body1;
+  RefBody* body2;
+  float friction;
+};
+
+struct ReferenceWorld
+{
+  // Copies the bodies of world, in float, and drops any earlier state.
+  void Load(const World& world);
+
+  // One World::Step with DefaultSolverPolicy.
+  void Step(float dt);
+
+  // The mirror of World::bodies[i].
+  const RefBody& Dynamic(int i) const { return bodies[i]; }
+
+  RefVec2 gravity;
+  int iterations;
+  int numDynamic;
+
+  // World::bodies, then World::staticBodies.
+  std::vector<RefBody> bodies;
+  std::map<uint16_t, RefArbiter> arbiters;
+
+private:
+  void BroadPhase();
+};
+
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+/*
+  Floating origin and region streaming. See Region.h.
+*/
+
+#include "Region.h"
+#include "World.h"
+#include "Body.h"
+
+#include <string.h>
+
+namespace {
+
+// Region of a local coordinate relative to the center, rounding down.
+int8_t RegionOf(SQ7x8 v)
+{
+  const int16_t size = RegionStreamer::REGION_SIZE << 8;
+  int16_t i = v.getInternal();
+  return i >= 0 ? i / size : -((-i + size - 1) / size);
+}
+
+SQ7x8 RegionOffset(int8_t regions)
+{
+  return SQ7x8::fromInternal(regions * (RegionStreamer::REGION_SIZE << 8));
+}
+
+// v + d, held at the ends of the SQ7x8 range for bodies left far outside.
+SQ7x8 Shifted(SQ7x8 v, SQ7x8 d)
+{
+  int32_t i = static_cast<int32_t>(v.getInternal()) + d.getInternal();
+  return SQ7x8::fromInternal(i < -32768 ? -32768 : i > 32767 ? 32767 : i);
+}
+
+Vec2 Shifted(const Vec2& v, const Vec2& d)
+{
+  return Vec2(Shifted(v.x, d.x), Shifted(v.y, d.y));
+}
+
+}
+
+RegionStreamer::RegionStreamer(World& world, uint8_t* buffer, size_t capacity) :
+  world(world), buffer(buffer), capacity(capacity), numFrozen(0), failedFreezes(0)
+{
+  center.x = 0;
+  center.y = 0;
+}
+
+bool RegionStreamer::Follow(const Vec2& camera)
+{
+  int8_t dx = RegionOf(camera.x);
+  int8_t dy = RegionOf(camera.y);
+  if (dx == 0 && dy == 0)
+    return false;
+
+  Recenter(dx < 0 ? -1 : dx > 0 ? 1 : 0, dy < 0 ? -1 : dy > 0 ? 1 : 0);
+  return true;
+}
+
+void RegionStreamer::Recenter(int8_t dx, int8_t dy)
+{
+  center.x += dx;
+  center.y += dy;
+  lastShift.Set(-RegionOffset(dx), -RegionOffset(dy));
+
+  // One region at a time keeps the shifted positions of the active block
+  // inside SQ7x8 range; bodies outside it that could not be frozen clamp.
+  for (int i = 0; i < (int)world.bodies.size(); ++i)
+    world.bodies[i]->SetPosition(Shifted(world.bodies[i]->position, lastShift));
+  for (int i = 0; i < (int)world.staticBodies.size(); ++i)
+    world.staticBodies[i]->SetPosition(Shifted(world.staticBodies[i]->position, lastShift));
+  for (int i = 0; i < world.numParticles; ++i)
+    world.particles[i].position = Shifted(world.particles[i].position, lastShift);
+  world.RefreshStatics();
+
+  FreezeOutside();
+  Thaw();
+}
+
+void RegionStreamer::FreezeOutside()
+{
+  // Destroy moves the last body into the freed slot, so walk backwards.
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    std::vector<Body*>& list = pass == 0 ? world.bodies : world.staticBodies;
+    for (int i = (int)list.size() - 1; i >= 0; --i)
+    {
+      Body* b = list[i];
+      int8_t rx = RegionOf(b->position.x);
+      int8_t ry = RegionOf(b->position.y);
+      if (rx >= -1 && rx <= 1 && ry >= -1 && ry <= 1)
+        continue;
+      if (!world.pool.Owns(b))
+        continue;
+      if (!Freeze(b, rx, ry))
+        ++failedFreezes;
+    }
+  }
+}
+
+bool RegionStreamer::Freeze(Body* b, int8_t rx, int8_t ry)
+{
+  if ((numFrozen + 1) * sizeof(FrozenBody) > capacity)
+    return false;
+
+  FrozenBody f;
+  f.region.x = center.x + rx;
+  f.region.y = center.y + ry;
+  f.body = ToSceneBody(*b);
+  f.body.x -= RegionOffset(rx).getInternal();
+  f.body.y -= RegionOffset(ry).getInternal();
+  f.categoryBits = b->categoryBits;
+  f.maskBits = b->maskBits;
+  f.groupIndex = b->groupIndex;
+  f.flags = (b->isSensor ? 1 : 0) | (b->isKinematic ? 2 : 0);
+
+  memcpy(buffer + numFrozen * sizeof(FrozenBody), &f, sizeof(FrozenBody));
+  ++numFrozen;
+
+  world.Destroy(b);
+  return true;
+}
+
+void RegionStreamer::Thaw()
+{
+  uint16_t kept = 0;
+  for (uint16_t n = 0; n < numFrozen; ++n)
+  {
+    FrozenBody f;
+    memcpy(&f, buffer + n * sizeof(FrozenBody), sizeof(FrozenBody));
+
+    int8_t rx = f.region.x - center.x;
+    int8_t ry = f.region.y - center.y;
+    Body* b = 0;
+    if (rx >= -1 && rx <= 1 && ry >= -1 && ry <= 1)
+      b = world.pool.Allocate();
+
+    if (b)
+    {
+      SceneBody s = f.body;
+      s.x += RegionOffset(rx).getInternal();
+      s.y += RegionOffset(ry).getInternal();
+      ApplySceneBody(*b, s);
+      b->categoryBits = f.categoryBits;
+      b->maskBits = f.maskBits;
+      b->groupIndex = f.groupIndex;
+      b->isSensor = (f.flags & 1) != 0;
+      b->isKinematic = (f.flags & 2) != 0;
+      if (world.Add(b))
+        continue;
+      world.pool.Free(b);
+    }
+
+    // Still outside, or no room yet: keep the record.
+    if (kept != n)
+      memcpy(buffer + kept * sizeof(FrozenBody), &f, sizeof(FrozenBody));
+    ++kept;
+  }
+  numFrozen = kept;
+}
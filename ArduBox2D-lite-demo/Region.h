@@ -0,0 +1,99 @@
+/*
+  Floating origin for levels larger than the SQ7x8 range.
+
+  The level is a grid of square regions, REGION_SIZE units on a side, named
+  by signed 8-bit region coordinates. World positions are local to the
+  origin of the center region, and only the 3x3 block of regions around it
+  is simulated, which keeps every active body within [-REGION_SIZE,
+  2 * REGION_SIZE) on both axes. When the camera leaves the center region,
+  Follow shifts all bodies and particles by one region, freezes the pooled
+  bodies that fell out of the block into a caller-supplied buffer and thaws
+  the frozen bodies of the regions that came into it. A body that finds the
+  pool empty, or that World::Add refuses, stays frozen until a later thaw.
+
+  Only pooled bodies (World::Create, LoadScene) are frozen; keep bodies
+  added with World::Add, such as the player, near the camera. A frozen body
+  is destroyed, so pointers to it go stale, and loses its arbiters. The
+  tilemap origin is not moved: shift it, or swap maps, in step with center.
+
+  Bodies that stay active outside the block, because they are not pooled or
+  the buffer was full (counted in failedFreezes), keep being shifted with
+  every recenter. Their positions stop at the edge of the SQ7x8 range
+  instead of wrapping around into the block.
+*/
+
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MathUtils.h"
+#include "Scene.h"
+
+struct World;
+struct Body;
+
+// Side of a region in world units. A recenter briefly leaves bodies in
+// [-2 * size, 3 * size) before freezing, which has to fit in SQ7x8.
+#ifndef ARDUBOX2D_REGION_SIZE
+#define ARDUBOX2D_REGION_SIZE 32
+#endif
+
+#if ARDUBOX2D_REGION_SIZE > 42
+#error "ARDUBOX2D_REGION_SIZE must be at most 42"
+#endif
+
+struct RegionCoord
+{
+  int8_t x, y;
+};
+
+// A frozen body: its region plus its state relative to that region.
+struct FrozenBody
+{
+  RegionCoord region;
+  SceneBody body;
+  uint8_t categoryBits;
+  uint8_t maskBits;
+  int8_t groupIndex;
+  uint8_t flags;
+};
+
+struct RegionStreamer
+{
+  enum {REGION_SIZE = ARDUBOX2D_REGION_SIZE};
+
+  RegionStreamer(World& world, uint8_t* buffer, size_t capacity);
+
+  // Recenters on the region containing camera, a world-local position, one
+  // region at a time. Returns true if the origin moved; camera is then
+  // stale and should be shifted by Shift().
+  bool Follow(const Vec2& camera);
+
+  // Moves the center by dx, dy regions, each -1, 0 or 1.
+  void Recenter(int8_t dx, int8_t dy);
+
+  // Freezes every pooled body outside the active block, e.g. after a level
+  // load placed bodies anywhere in it.
+  void FreezeOutside();
+
+  // How far positions moved in the last Recenter.
+  Vec2 Shift() const { return lastShift; }
+
+  World& world;
+  RegionCoord center;
+
+  uint8_t* buffer;
+  size_t capacity;
+  uint16_t numFrozen;
+  uint16_t failedFreezes;  // bodies left active because the buffer was full
+
+private:
+  bool Freeze(Body* body, int8_t rx, int8_t ry);
+  void Thaw();
+
+  Vec2 lastShift;
+};
+
+#endif
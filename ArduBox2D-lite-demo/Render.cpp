@@ -0,0 +1,119 @@
+/*
+  Double-buffered render state, see Render.h.
+*/
+
+#include "Render.h"
+#include "World.h"
+
+static void Copy(const Body* b, RenderBody& out)
+{
+  out.position = b->position;
+  out.rotation = b->rotation;
+
+  // Bodies that moved this step get their vertices at the next BroadPhase.
+  if (b->transformDirty)
+  {
+    b->ComputeVertices(out.vertices);
+  }
+  else
+  {
+    for (int i = 0; i < 4; ++i)
+      out.vertices[i] = b->vertices[i];
+  }
+}
+
+#ifndef __AVR__
+// A RenderBody is all SQ7x8 words. Moving them with the atomic builtins
+// leaves a copy that overlaps Publish stale, which Intact() reports, rather
+// than a data race.
+enum {RENDER_WORDS = sizeof(RenderBody) / sizeof(int16_t)};
+
+static void StoreBody(RenderBody& to, const RenderBody& from)
+{
+  int16_t* d = reinterpret_cast<int16_t*>(&to);
+  const int16_t* s = reinterpret_cast<const int16_t*>(&from);
+  for (int i = 0; i < RENDER_WORDS; ++i)
+    __atomic_store_n(d + i, s[i], __ATOMIC_RELAXED);
+}
+
+static void LoadBody(RenderBody& to, const RenderBody& from)
+{
+  int16_t* d = reinterpret_cast<int16_t*>(&to);
+  const int16_t* s = reinterpret_cast<const int16_t*>(&from);
+  for (int i = 0; i < RENDER_WORDS; ++i)
+    d[i] = __atomic_load_n(s + i, __ATOMIC_RELAXED);
+}
+#endif
+
+static void Put(const Body* b, RenderBody& out)
+{
+#ifdef __AVR__
+  Copy(b, out);
+#else
+  RenderBody body;
+  Copy(b, body);
+  StoreBody(out, body);
+#endif
+}
+
+void RenderBuffer::Publish(const World& world)
+{
+#ifdef __AVR__
+  uint16_t gen = ++generation;
+#else
+  // Seen by Intact() before any of the copies below.
+  uint16_t gen = generation.load(std::memory_order_relaxed) + 1;
+  generation.store(gen, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+#endif
+  uint8_t back = ((gen >> 1) & 1) ^ 1;
+  uint8_t n = 0;
+  int total = world.staticBodies.size() + world.bodies.size();
+
+  for (int i = 0; i < (int)world.staticBodies.size() && n < SIZE; ++i)
+    Put(world.staticBodies[i], bodies[back][n++]);
+  for (int i = 0; i < (int)world.bodies.size() && n < SIZE; ++i)
+    Put(world.bodies[i], bodies[back][n++]);
+
+#ifdef __AVR__
+  count[back] = n;
+#else
+  __atomic_store_n(&count[back], n, __ATOMIC_RELAXED);
+#endif
+  dropped = total - n;
+#ifdef __AVR__
+  ++generation;
+#else
+  generation.store(gen + 1, std::memory_order_release);
+#endif
+}
+
+bool RenderBuffer::Intact(uint16_t gen) const
+{
+#ifdef __AVR__
+  uint16_t now = generation;
+#else
+  // Orders the caller's reads of the half before the load below.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint16_t now = generation.load(std::memory_order_relaxed);
+#endif
+  // The half of finished Publish gen / 2 is next written by the one that
+  // begins at gen / 2 * 2 + 3.
+  return uint16_t(now - (gen & ~1)) < 3;
+}
+
+#ifndef __AVR__
+uint8_t RenderBuffer::CopyFront(RenderBody* out) const
+{
+  for (;;)
+  {
+    uint16_t gen = Generation();
+    uint8_t half = (gen >> 1) & 1;
+    uint8_t n = __atomic_load_n(&count[half], __ATOMIC_RELAXED);
+    for (uint8_t i = 0; i < n; ++i)
+      LoadBody(out[i], bodies[half][i]);
+    if (Intact(gen))
+      return n;
+  }
+}
+#endif
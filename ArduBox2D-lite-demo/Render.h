@@ -0,0 +1,111 @@
+/*
+  Drawing helpers. Bodies keep their corners in world space (Body::vertices),
+  refreshed only when they move, so a renderer just offsets and rounds them.
+
+  A RenderBuffer keeps drawing apart from stepping. Once it is set with
+  World::SetRenderBuffer, every step ends by copying each body's position,
+  rotation and corners into the buffer's back half and then flipping the
+  halves, so Front() always holds the last finished step and never changes
+  while a step runs. On the device, draw it between World::BeginStep and
+  World::EndStep.
+
+  Front() is for the thread that steps, which is the only one on the device.
+  On a host the drawing may run on another thread: it takes the bodies with
+  CopyFront() instead. Publish and CopyFront move the bodies word by word
+  with relaxed atomic stores and loads, and a generation counter tells
+  CopyFront when the step after next began writing over the half it read,
+  in which case it reads the new front again.
+*/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdint.h>
+#ifndef __AVR__
+#include <atomic>
+#endif
+
+#include "Body.h"
+
+// Bodies a RenderBuffer holds, statics first. 22 bytes each, twice.
+#ifndef ARDUBOX2D_RENDER_BODIES
+#define ARDUBOX2D_RENDER_BODIES 10
+#endif
+
+struct World;
+
+// A body's corners in screen pixels, in Body::vertices order. Screen y grows
+// downwards.
+struct ScreenQuad
+{
+  int16_t x[4];
+  int16_t y[4];
+};
+
+// originX, originY: the pixel where world (0, 0) is drawn. Rounds on the raw
+// values so corners near the edge of the SQ7x8 range do not wrap.
+inline void ToScreen(const Vec2 vertices[4], int16_t originX, int16_t originY, ScreenQuad& out)
+{
+  for (int i = 0; i < 4; ++i)
+  {
+    out.x[i] = originX + ((vertices[i].x.getInternal() + 0x80) >> 8);
+    out.y[i] = originY - ((vertices[i].y.getInternal() + 0x80) >> 8);
+  }
+}
+
+inline void ToScreen(const Body& body, int16_t originX, int16_t originY, ScreenQuad& out)
+{
+  ToScreen(body.vertices, originX, originY, out);
+}
+
+// What a renderer needs of a body, as of the end of a step.
+struct RenderBody
+{
+  Vec2 position;
+  SQ7x8 rotation;
+  Vec2 vertices[4];
+};
+
+struct RenderBuffer
+{
+  enum {SIZE = ARDUBOX2D_RENDER_BODIES};
+
+  RenderBuffer() : generation(0), dropped(0) { count[0] = count[1] = 0; }
+
+  // Copies the world's static, then dynamic, bodies into the back half and
+  // makes it the front. Bodies past SIZE are counted in dropped.
+  void Publish(const World& world);
+
+  // Bumped as each Publish begins and again as it ends, so gen / 2 is the
+  // number of finished ones and its lowest bit the front half.
+#ifdef __AVR__
+  uint16_t Generation() const { return generation; }
+#else
+  uint16_t Generation() const { return generation.load(std::memory_order_acquire); }
+#endif
+
+  const RenderBody* Front(uint16_t gen) const { return bodies[(gen >> 1) & 1]; }
+  uint8_t FrontCount(uint16_t gen) const { return count[(gen >> 1) & 1]; }
+  const RenderBody* Front() const { return Front(Generation()); }
+  uint8_t FrontCount() const { return FrontCount(Generation()); }
+
+  // False once a Publish has begun on the half Front(gen) returned.
+  bool Intact(uint16_t gen) const;
+
+#ifndef __AVR__
+  // Copies the front half into out, which holds SIZE bodies, from any
+  // thread, and returns how many there are.
+  uint8_t CopyFront(RenderBody* out) const;
+#endif
+
+  RenderBody bodies[2][SIZE];
+  uint8_t count[2];
+#ifdef __AVR__
+  uint16_t generation;
+#else
+  std::atomic<uint16_t> generation;
+#endif
+  uint16_t dropped;
+};
+
+#endif
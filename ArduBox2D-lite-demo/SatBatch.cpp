@@ -0,0 +1,99 @@
+/*
+  SSE2 face separation tests, see SatBatch.h.
+*/
+
+#include "SatBatch.h"
+
+#if ARDUBOX2D_SAT_BATCH
+
+#include <emmintrin.h>
+
+#include "Body.h"
+
+void SatBatch::Add(const Body* bodyA, const Mat22& rotA, const Body* bodyB, const Mat22& rotB)
+{
+  // Same half widths as Collide().
+  Vec2 hA = 0.5 * bodyA->width;
+  Vec2 hB = 0.5 * bodyB->width;
+
+  int i = count++;
+  posAx[i] = bodyA->position.x.getInternal();
+  posAy[i] = bodyA->position.y.getInternal();
+  posBx[i] = bodyB->position.x.getInternal();
+  posBy[i] = bodyB->position.y.getInternal();
+  hAx[i] = hA.x.getInternal();
+  hAy[i] = hA.y.getInternal();
+  hBx[i] = hB.x.getInternal();
+  hBy[i] = hB.y.getInternal();
+  rotA11[i] = rotA.col1.x.getInternal();
+  rotA21[i] = rotA.col1.y.getInternal();
+  rotA12[i] = rotA.col2.x.getInternal();
+  rotA22[i] = rotA.col2.y.getInternal();
+  rotB11[i] = rotB.col1.x.getInternal();
+  rotB21[i] = rotB.col1.y.getInternal();
+  rotB12[i] = rotB.col2.x.getInternal();
+  rotB22[i] = rotB.col2.y.getInternal();
+}
+
+// MulAdd() in each lane: madd sums the two 32-bit products, then bits 8 to
+// 23 are sign-extended so the pack truncates instead of saturating.
+static inline __m128i MulAdd8(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, c), _mm_unpacklo_epi16(b, d));
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, c), _mm_unpackhi_epi16(b, d));
+  lo = _mm_srai_epi32(_mm_slli_epi32(lo, 8), 16);
+  hi = _mm_srai_epi32(_mm_slli_epi32(hi, 8), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+// abs() wraps -128.0 back onto itself; so does this.
+static inline __m128i Abs8(__m128i a)
+{
+  return _mm_max_epi16(a, _mm_sub_epi16(_mm_setzero_si128(), a));
+}
+
+static inline __m128i Load8(const int16_t* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+uint8_t SatBatch::Separated()
+{
+  // Unused lanes hold an earlier pair or zeros; they are masked off below.
+  __m128i a11 = Load8(rotA11), a21 = Load8(rotA21), a12 = Load8(rotA12), a22 = Load8(rotA22);
+  __m128i b11 = Load8(rotB11), b21 = Load8(rotB21), b12 = Load8(rotB12), b22 = Load8(rotB22);
+  __m128i hAxv = Load8(hAx), hAyv = Load8(hAy), hBxv = Load8(hBx), hByv = Load8(hBy);
+
+  // Written out from Collide(), row by row of the transposed rotations.
+  __m128i dpx = _mm_sub_epi16(Load8(posBx), Load8(posAx));
+  __m128i dpy = _mm_sub_epi16(Load8(posBy), Load8(posAy));
+  __m128i dAx = MulAdd8(a11, dpx, a21, dpy);
+  __m128i dAy = MulAdd8(a12, dpx, a22, dpy);
+  __m128i dBx = MulAdd8(b11, dpx, b21, dpy);
+  __m128i dBy = MulAdd8(b12, dpx, b22, dpy);
+
+  // absC = Abs(RotA^T * RotB)
+  __m128i c11 = Abs8(MulAdd8(a11, b11, a21, b21));
+  __m128i c21 = Abs8(MulAdd8(a12, b11, a22, b21));
+  __m128i c12 = Abs8(MulAdd8(a11, b12, a21, b22));
+  __m128i c22 = Abs8(MulAdd8(a12, b12, a22, b22));
+
+  // faceA = Abs(dA) - hA - absC * hB
+  __m128i faceAx = _mm_sub_epi16(_mm_sub_epi16(Abs8(dAx), hAxv), MulAdd8(c11, hBxv, c12, hByv));
+  __m128i faceAy = _mm_sub_epi16(_mm_sub_epi16(Abs8(dAy), hAyv), MulAdd8(c21, hBxv, c22, hByv));
+
+  // faceB = Abs(dB) - absC^T * hA - hB
+  __m128i faceBx = _mm_sub_epi16(_mm_sub_epi16(Abs8(dBx), MulAdd8(c11, hAxv, c21, hAyv)), hBxv);
+  __m128i faceBy = _mm_sub_epi16(_mm_sub_epi16(Abs8(dBy), MulAdd8(c12, hAxv, c22, hAyv)), hByv);
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i out = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi16(faceAx, zero), _mm_cmpgt_epi16(faceAy, zero)),
+                             _mm_or_si128(_mm_cmpgt_epi16(faceBx, zero), _mm_cmpgt_epi16(faceBy, zero)));
+  uint8_t mask = static_cast<uint8_t>(_mm_movemask_epi8(_mm_packs_epi16(out, out)));
+
+  uint8_t used = static_cast<uint8_t>((1 << count) - 1);
+  count = 0;
+  return mask & used;
+}
+
+#endif
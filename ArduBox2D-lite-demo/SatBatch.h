@@ -0,0 +1,51 @@
+/*
+  Batched face separation tests for host builds.
+
+  Collide() starts every pair with the four face tests of the separating axis
+  test and most pairs that pass the bounds check stop there. On hosts with
+  SSE2, World::BroadPhase gathers the pairs SAT_BATCH_SIZE at a time and runs
+  those tests in 16-bit lanes, doing the same fixed-point arithmetic as the
+  scalar code, so only the survivors reach Collide(). Compiled only when
+  ARDUBOX2D_SAT_BATCH is on (see Config.h).
+*/
+
+#ifndef SATBATCH_H
+#define SATBATCH_H
+
+#include "Config.h"
+
+#if ARDUBOX2D_SAT_BATCH
+
+#include <stdint.h>
+#include <string.h>
+
+#include "MathUtils.h"
+
+struct Body;
+
+const int SAT_BATCH_SIZE = 8;
+
+// One pair per lane, raw SQ7x8 values. Rotations are stored by column as in
+// Mat22.
+struct SatBatch
+{
+  SatBatch() { memset(this, 0, sizeof(*this)); }
+
+  void Add(const Body* bodyA, const Mat22& rotA, const Body* bodyB, const Mat22& rotB);
+
+  // Bit i is set if pair i is separated along a face axis, that is, if
+  // Collide() would return no points without clipping.
+  uint8_t Separated();
+
+  int16_t posAx[SAT_BATCH_SIZE], posAy[SAT_BATCH_SIZE];
+  int16_t posBx[SAT_BATCH_SIZE], posBy[SAT_BATCH_SIZE];
+  int16_t hAx[SAT_BATCH_SIZE], hAy[SAT_BATCH_SIZE];
+  int16_t hBx[SAT_BATCH_SIZE], hBy[SAT_BATCH_SIZE];
+  int16_t rotA11[SAT_BATCH_SIZE], rotA21[SAT_BATCH_SIZE], rotA12[SAT_BATCH_SIZE], rotA22[SAT_BATCH_SIZE];
+  int16_t rotB11[SAT_BATCH_SIZE], rotB21[SAT_BATCH_SIZE], rotB12[SAT_BATCH_SIZE], rotB22[SAT_BATCH_SIZE];
+  int count;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/*
+  PROGMEM scene loader. See Scene.h.
+*/
+
+#include "Scene.h"
+#include "World.h"
+#include "Body.h"
+
+#include <Arduino.h>
+
+SceneBody ToSceneBody(const Body& b)
+{
+  SceneBody s;
+  s.width = b.width.x.getInternal();
+  s.height = b.width.y.getInternal();
+  s.x = b.position.x.getInternal();
+  s.y = b.position.y.getInternal();
+  s.rotation = b.rotation.getInternal();
+  s.vx = b.velocity.x.getInternal();
+  s.vy = b.velocity.y.getInternal();
+  s.angularVelocity = b.angularVelocity.getInternal();
+  s.friction = b.friction.getInternal();
+  s.mass = b.mass.getInternal();
+  s.invMass = b.invMass.getInternal();
+  s.I = b.I.getInternal();
+  s.invI = b.invI.getInternal();
+  return s;
+}
+
+void ApplySceneBody(Body& b, const SceneBody& s)
+{
+  // The fields World keeps survive, so a body already in a world stays
+  // where World::GetBody and the arbiters expect it.
+  uint8_t index = b.index;
+  uint8_t lod = b.lod;
+  Arbiter* arbiterList = b.arbiterList;
+  b = Body();
+  b.index = index;
+  b.lod = lod;
+  b.arbiterList = arbiterList;
+
+  b.width.Set(SQ7x8::fromInternal(s.width), SQ7x8::fromInternal(s.height));
+  b.SetPosition(Vec2(SQ7x8::fromInternal(s.x), SQ7x8::fromInternal(s.y)));
+  b.SetRotation(SQ7x8::fromInternal(s.rotation));
+  b.velocity.Set(SQ7x8::fromInternal(s.vx), SQ7x8::fromInternal(s.vy));
+  b.angularVelocity = SQ7x8::fromInternal(s.angularVelocity);
+  b.friction = SQ7x8::fromInternal(s.friction);
+  b.mass = SQ7x8::fromInternal(s.mass);
+  b.invMass = SQ7x8::fromInternal(s.invMass);
+  b.I = SQ7x8::fromInternal(s.I);
+  b.invI = SQ7x8::fromInternal(s.invI);
+  b.UpdateTransform();
+}
+
+int LoadScene(World& world, const SceneBody* scene, uint8_t count)
+{
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    Body* b = world.pool.Allocate();
+    if (!b)
+      return i;
+
+    SceneBody s;
+    memcpy_P(&s, scene + i, sizeof(SceneBody));
+    ApplySceneBody(*b, s);
+    if (!world.Add(b))
+    {
+      world.pool.Free(b);
+      return i;
+    }
+  }
+  return count;
+}
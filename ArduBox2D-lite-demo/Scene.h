@@ -0,0 +1,103 @@
+/*
+  Scenes described at compile time and stored in PROGMEM.
+
+  SceneBox and SceneStaticBox are constexpr, so the mass properties that
+  Body::Set would compute with fixed-point divisions are worked out by the
+  compiler in double precision instead, and the whole scene lands in flash
+  as ready-made SQ7x8 words:
+
+    const SceneBody level[] PROGMEM = {
+      SceneStaticBox(100.0, 20.0).At(0.0, -9.0),
+      SceneBox(5.0, 10.0, 1.0).At(5.0, 60.0).Spin(-8.0),
+    };
+    LoadScene(world, level, 2);
+
+  Values are truncated to SQ7x8 like a runtime conversion would. Unlike
+  Body::Set, a large box's moment of inertia does not overflow on the way.
+*/
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+
+struct World;
+struct Body;
+
+// Raw SQ7x8 values, see SceneWord.
+struct SceneBody
+{
+  int16_t width, height;
+  int16_t x, y;
+  int16_t rotation;
+  int16_t vx, vy;
+  int16_t angularVelocity;
+  int16_t friction;
+  int16_t mass, invMass;
+  int16_t I, invI;
+
+  constexpr SceneBody At(double px, double py) const;
+  constexpr SceneBody Rotate(double angle) const;
+  constexpr SceneBody Move(double velocityX, double velocityY) const;
+  constexpr SceneBody Spin(double velocity) const;
+  constexpr SceneBody Friction(double f) const;
+};
+
+// SQ7x8 word for v, saturated like FLT_MAX in Body.cpp.
+constexpr int16_t SceneWord(double v)
+{
+  return v >= 127.99 ? 32765 : v <= -128.0 ? -32768 : static_cast<int16_t>(v * 256.0);
+}
+
+constexpr SceneBody SceneBox(double w, double h, double mass)
+{
+  return SceneBody{ SceneWord(w), SceneWord(h), 0, 0, 0, 0, 0, 0, SceneWord(0.2),
+    SceneWord(mass), SceneWord(1.0 / mass),
+    SceneWord(mass * (w * w + h * h) / 12.0), SceneWord(12.0 / (mass * (w * w + h * h))) };
+}
+
+constexpr SceneBody SceneStaticBox(double w, double h)
+{
+  return SceneBody{ SceneWord(w), SceneWord(h), 0, 0, 0, 0, 0, 0, SceneWord(0.2),
+    SceneWord(127.99), 0, SceneWord(127.99), 0 };
+}
+
+constexpr SceneBody SceneBody::At(double px, double py) const
+{
+  return SceneBody{ width, height, SceneWord(px), SceneWord(py), rotation, vx, vy, angularVelocity, friction, mass, invMass, I, invI };
+}
+
+constexpr SceneBody SceneBody::Rotate(double angle) const
+{
+  return SceneBody{ width, height, x, y, SceneWord(angle), vx, vy, angularVelocity, friction, mass, invMass, I, invI };
+}
+
+constexpr SceneBody SceneBody::Move(double velocityX, double velocityY) const
+{
+  return SceneBody{ width, height, x, y, rotation, SceneWord(velocityX), SceneWord(velocityY), angularVelocity, friction, mass, invMass, I, invI };
+}
+
+constexpr SceneBody SceneBody::Spin(double velocity) const
+{
+  return SceneBody{ width, height, x, y, rotation, vx, vy, SceneWord(velocity), friction, mass, invMass, I, invI };
+}
+
+constexpr SceneBody SceneBody::Friction(double f) const
+{
+  return SceneBody{ width, height, x, y, rotation, vx, vy, angularVelocity, SceneWord(f), mass, invMass, I, invI };
+}
+
+// Copies count bodies from a PROGMEM scene into pooled bodies and adds them
+// to the world. Stops at the first body that does not fit in the pool or that
+// World::Add refuses, and returns how many were added.
+int LoadScene(World& world, const SceneBody* scene, uint8_t count);
+
+// Conversions between a body and its scene description, e.g. to store a body
+// and bring it back later. ApplySceneBody resets the body's other fields,
+// except the ones World keeps (index, lod and arbiterList), so it also works
+// on a body that is in a world, as long as the scene body is static or
+// dynamic like it.
+SceneBody ToSceneBody(const Body& body);
+void ApplySceneBody(Body& body, const SceneBody& scene);
+
+#endif
@@ -0,0 +1,338 @@
+/*
+  Binary world snapshots and input logs. See Snapshot.h for the format.
+*/
+
+#include "Snapshot.h"
+#include "World.h"
+#include "Body.h"
+
+#include <Arduino.h>
+
+typedef std::map<ArbiterKey, Arbiter>::iterator ArbIter;
+typedef std::map<ArbiterKey, Arbiter>::const_iterator ArbConstIter;
+
+enum
+{
+  FLAG_ACCUMULATE_IMPULSES = 0x01,
+  FLAG_WARM_STARTING = 0x02,
+  FLAG_POSITION_CORRECTION = 0x04
+};
+
+namespace {
+
+struct Writer
+{
+  Writer(uint8_t* buffer, size_t capacity) : p(buffer), end(buffer + capacity), ok(true) {}
+
+  void U8(uint8_t v)
+  {
+    if (p == end) { ok = false; return; }
+    *p++ = v;
+  }
+
+  void U16(uint16_t v)
+  {
+    U8(v & 0xFF);
+    U8(v >> 8);
+  }
+
+  void Fixed(SQ7x8 v) { U16(static_cast<uint16_t>(v.getInternal())); }
+  void Vector(const Vec2& v) { Fixed(v.x); Fixed(v.y); }
+
+  uint8_t* p;
+  uint8_t* end;
+  bool ok;
+};
+
+struct Reader
+{
+  Reader(const uint8_t* buffer, size_t size) : p(buffer), end(buffer + size), ok(true) {}
+
+  uint8_t U8()
+  {
+    if (p == end) { ok = false; return 0; }
+    return *p++;
+  }
+
+  uint16_t U16()
+  {
+    uint16_t lo = U8();
+    return lo | (static_cast<uint16_t>(U8()) << 8);
+  }
+
+  SQ7x8 Fixed() { return SQ7x8::fromInternal(static_cast<int16_t>(U16())); }
+  Vec2 Vector() { SQ7x8 x = Fixed(); return Vec2(x, Fixed()); }
+
+  void Skip(size_t n)
+  {
+    if (static_cast<size_t>(end - p) < n) { ok = false; p = end; return; }
+    p += n;
+  }
+
+  const uint8_t* p;
+  const uint8_t* end;
+  bool ok;
+};
+
+// Whether the compiled solver policy runs with the saved flags. The runtime
+// policy takes whatever was saved; the default one has them all fixed on.
+template<class Policy> struct PolicyFlags
+{
+  static bool Accepts(uint8_t) { return true; }
+};
+
+template<> struct PolicyFlags<DefaultSolverPolicy>
+{
+  static bool Accepts(uint8_t flags)
+  {
+    return flags == (FLAG_ACCUMULATE_IMPULSES | FLAG_WARM_STARTING | FLAG_POSITION_CORRECTION);
+  }
+};
+
+}
+
+size_t World::SaveSnapshot(uint8_t* buffer, size_t capacity) const
+{
+  Writer w(buffer, capacity);
+
+  uint8_t flags = 0;
+  if (SolverPolicy::AccumulateImpulses()) flags |= FLAG_ACCUMULATE_IMPULSES;
+  if (SolverPolicy::WarmStarting()) flags |= FLAG_WARM_STARTING;
+  if (SolverPolicy::PositionCorrection()) flags |= FLAG_POSITION_CORRECTION;
+
+  w.U8(SNAPSHOT_MAGIC);
+  w.U8(SNAPSHOT_VERSION);
+  w.U8(flags);
+  w.U8(iterations);
+  w.U8(bodies.size());
+  w.U16(arbiters.size());
+  w.Vector(gravity);
+  w.U8(lodInterval);
+  w.U8(lodIterations);
+  w.U8(lodFrame);
+  w.Fixed(lodTime);
+
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    const Body* b = bodies[i];
+    w.Vector(b->position);
+    w.Fixed(b->rotation);
+    w.Vector(b->velocity);
+    w.Fixed(b->angularVelocity);
+    w.Vector(b->force);
+    w.Fixed(b->torque);
+    w.Vector(b->width);
+    w.Fixed(b->friction);
+    w.Fixed(b->mass);
+    w.Fixed(b->invMass);
+    w.Fixed(b->I);
+    w.Fixed(b->invI);
+    w.U8(b->categoryBits);
+    w.U8(b->maskBits);
+    w.U8(b->groupIndex);
+    w.U8((b->isSensor ? 1 : 0) | (b->isKinematic ? 2 : 0));
+    w.U8(b->lod);
+  }
+
+  for (ArbConstIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+  {
+    const Arbiter& a = arb->second;
+    w.U8(a.body1);
+    w.U8(a.body2);
+    w.U8(a.numContacts);
+    if (a.body2 >= TILE_INDEX)
+    {
+      const TileRun& run = tileRuns[a.body2 - TILE_INDEX];
+      w.U8(run.row);
+      w.U8(run.column);
+      w.U8(run.length);
+    }
+
+    for (int i = 0; i < a.numContacts; ++i)
+    {
+      const Contact& c = a.contacts[i];
+      w.U16(c.feature.value);
+      w.Fixed(c.Pn);
+      w.Fixed(c.Pt);
+      w.Fixed(c.Pnb);
+    }
+  }
+
+  return w.ok ? w.p - buffer : 0;
+}
+
+bool World::LoadSnapshot(const uint8_t* buffer, size_t size)
+{
+  Reader r(buffer, size);
+
+  if (r.U8() != SNAPSHOT_MAGIC || r.U8() != SNAPSHOT_VERSION)
+    return false;
+
+  uint8_t flags = r.U8();
+  uint8_t numIterations = r.U8();
+  uint8_t numBodies = r.U8();
+  uint16_t numArbiters = r.U16();
+  Vec2 g = r.Vector();
+  uint8_t numLodInterval = r.U8();
+  uint8_t numLodIterations = r.U8();
+  uint8_t frame = r.U8();
+  SQ7x8 time = r.Fixed();
+
+  if (!r.ok || numBodies != bodies.size() || !PolicyFlags<SolverPolicy>::Accepts(flags))
+    return false;
+
+  // Check the whole buffer before touching the world, so that a truncated or
+  // corrupt snapshot leaves it as it was.
+  Reader check = r;
+  for (int i = 0; i < numBodies && check.ok; ++i)
+  {
+    check.Skip(SNAPSHOT_BODY_SIZE - 1);
+    if (check.U8() > LOD_REDUCED)
+      return false;
+  }
+  for (uint16_t n = 0; n < numArbiters && check.ok; ++n)
+  {
+    uint8_t i = check.U8();
+    uint8_t j = check.U8();
+    uint8_t numContacts = check.U8();
+    // Every arbiter has a dynamic body1; static and tile bodies only pair
+    // with dynamic ones.
+    if (i >= bodies.size() || !HasBody(j) || i >= j || numContacts > Arbiter::MAX_POINTS)
+      return false;
+    if (j >= TILE_INDEX)
+    {
+      if (!tilemap)
+        return false;
+      check.Skip(SNAPSHOT_TILE_RUN_SIZE);
+    }
+    check.Skip(numContacts * SNAPSHOT_CONTACT_SIZE);
+  }
+  if (!check.ok)
+    return false;
+
+  accumulateImpulses = (flags & FLAG_ACCUMULATE_IMPULSES) != 0;
+  warmStarting = (flags & FLAG_WARM_STARTING) != 0;
+  positionCorrection = (flags & FLAG_POSITION_CORRECTION) != 0;
+  iterations = numIterations;
+  gravity = g;
+  lodInterval = numLodInterval;
+  lodIterations = numLodIterations;
+  lodFrame = frame;
+  lodTime = time;
+
+  for (int i = 0; i < numBodies; ++i)
+  {
+    Body* b = bodies[i];
+    b->SetPosition(r.Vector());
+    b->SetRotation(r.Fixed());
+    b->velocity = r.Vector();
+    b->angularVelocity = r.Fixed();
+    b->force = r.Vector();
+    b->torque = r.Fixed();
+    b->width = r.Vector();
+    b->friction = r.Fixed();
+    b->mass = r.Fixed();
+    b->invMass = r.Fixed();
+    b->I = r.Fixed();
+    b->invI = r.Fixed();
+    b->categoryBits = r.U8();
+    b->maskBits = r.U8();
+    b->groupIndex = r.U8();
+    uint8_t bodyFlags = r.U8();
+    b->isSensor = (bodyFlags & 1) != 0;
+    b->isKinematic = (bodyFlags & 2) != 0;
+    b->lod = r.U8();
+  }
+
+  // Rebuild the arbiters. The next BroadPhase supplies the contact geometry,
+  // matching on the restored feature ids.
+  ClearArbiters();
+  for (uint16_t n = 0; n < numArbiters; ++n)
+  {
+    uint8_t i = r.U8();
+    uint8_t j = r.U8();
+    uint8_t numContacts = r.U8();
+
+    // Tile runs go back into the slot they were saved from, so the arbiter
+    // keeps its key and BroadPhase finds the run there. InsertArbiter counts
+    // the refs.
+    if (j >= TILE_INDEX)
+    {
+      TileRun& run = tileRuns[j - TILE_INDEX];
+      run.row = r.U8();
+      run.column = r.U8();
+      run.length = r.U8();
+    }
+
+    Arbiter& arb = InsertArbiter(ArbiterKey(i, j))->second;
+    arb.numContacts = numContacts;
+
+    for (int k = 0; k < numContacts; ++k)
+    {
+      Contact& c = arb.contacts[k];
+      c.feature.value = r.U16();
+      c.Pn = r.Fixed();
+      c.Pt = r.Fixed();
+      c.Pnb = r.Fixed();
+    }
+  }
+
+  return true;
+}
+
+void PrintSnapshot(Print& out, const uint8_t* buffer, size_t size)
+{
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (buffer[i] < 0x10)
+      out.print('0');
+    out.print(buffer[i], HEX);
+    if ((i & 31) == 31 || i + 1 == size)
+      out.println();
+  }
+}
+
+InputLog::InputLog(uint8_t* buffer, uint16_t capacity)
+  : buffer(buffer), capacity(capacity)
+{
+  Clear();
+}
+
+void InputLog::Clear()
+{
+  length = 0;
+  numFrames = 0;
+}
+
+bool InputLog::Record(uint8_t input)
+{
+  // Extend the current run when the input has not changed.
+  if (length > 0 && buffer[length - 2] == input && buffer[length - 1] < 0xFF)
+  {
+    ++buffer[length - 1];
+    ++numFrames;
+    return true;
+  }
+
+  if (length + 2 > capacity)
+    return false;
+
+  buffer[length++] = input;
+  buffer[length++] = 1;
+  ++numFrames;
+  return true;
+}
+
+void Replay(World& world, const InputLog& log, SQ7x8 dt, InputHandler apply)
+{
+  for (uint16_t i = 0; i < log.length; i += 2)
+  {
+    uint8_t input = log.buffer[i];
+    for (uint8_t n = log.buffer[i + 1]; n > 0; --n)
+    {
+      if (apply)
+        apply(world, input);
+      world.Step(dt);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+/*
+  Binary world snapshots and input logs for deterministic replay.
+
+  World::SaveSnapshot/LoadSnapshot capture everything that carries over from
+  one World::Step to the next: every body with its level of detail, the
+  solver and level of detail settings, where the world is in its LOD
+  interval and, for each arbiter, the contact feature ids and accumulated
+  impulses used for warm starting. Arbiters with the tilemap also keep the
+  run of tiles they touch and its slot, so the world must have the same
+  tilemap set when loading. Contact geometry is not stored because
+  BroadPhase regenerates it at the start of every step. Values are written
+  as raw little-endian SQ7x8 words, so a snapshot taken on the device
+  restores bit-exactly on a host build.
+
+  The solver flags (World::accumulateImpulses and friends) are saved and
+  restored, but only RuntimeSolverPolicy reads them. DefaultSolverPolicy has
+  them all fixed on, so a build using it refuses a snapshot saved with any of
+  them off.
+
+  An InputLog records one input byte (e.g. the button state) per frame,
+  run-length encoded. Loading a snapshot and feeding the log through Replay()
+  re-simulates the captured frames exactly.
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MathUtils.h"
+
+struct World;
+class Print;
+
+enum
+{
+  SNAPSHOT_MAGIC = 0xB2,
+  SNAPSHOT_VERSION = 6,
+
+  SNAPSHOT_HEADER_SIZE = 16,
+  SNAPSHOT_BODY_SIZE = 37,
+  SNAPSHOT_ARBITER_SIZE = 3,
+  SNAPSHOT_TILE_RUN_SIZE = 3,
+  SNAPSHOT_CONTACT_SIZE = 8
+};
+
+// Upper bound on the bytes needed for a snapshot; arbiters only store the
+// contacts they actually have, and only tile arbiters store a run.
+inline size_t SnapshotSize(int numBodies, int numArbiters)
+{
+  return SNAPSHOT_HEADER_SIZE + numBodies * SNAPSHOT_BODY_SIZE +
+         numArbiters * (SNAPSHOT_ARBITER_SIZE + SNAPSHOT_TILE_RUN_SIZE + 2 * SNAPSHOT_CONTACT_SIZE);
+}
+
+// Writes a snapshot as hex text, 32 bytes per line, for capture over serial.
+void PrintSnapshot(Print& out, const uint8_t* buffer, size_t size);
+
+struct InputLog
+{
+  // The log stores (input, run length) byte pairs in caller-owned memory.
+  InputLog(uint8_t* buffer, uint16_t capacity);
+
+  void Clear();
+
+  // Appends the input for the next frame. Returns false when the buffer is full.
+  bool Record(uint8_t input);
+
+  uint16_t Frames() const { return numFrames; }
+
+  uint8_t* buffer;
+  uint16_t capacity;
+  uint16_t length;
+  uint16_t numFrames;
+};
+
+typedef void (*InputHandler)(World& world, uint8_t input);
+
+// Steps the world once per logged frame, handing each frame's input to apply
+// before the step. Load the starting snapshot first.
+void Replay(World& world, const InputLog& log, SQ7x8 dt, InputHandler apply);
+
+#endif
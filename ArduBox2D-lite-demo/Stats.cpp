@@ -0,0 +1,86 @@
+/*
+  Optional instrumentation for World::Step. See Stats.h.
+*/
+
+#include "Stats.h"
+
+#if ARDUBOX2D_STATS
+
+void WorldStats::Reset()
+{
+  steps = 0;
+  addsRefused = 0;
+
+  filteredPairs = 0;
+  aabbRejects = 0;
+  pairTests = 0;
+  satEarlyOuts = 0;
+  clipRejects = 0;
+  contactPoints = 0;
+  incrementalManifolds = 0;
+
+  arbiterInserts = 0;
+  arbiterUpdates = 0;
+  arbiterErases = 0;
+  solverOverflows = 0;
+  arenaHighWater = 0;
+  tileRunOverflows = 0;
+  sensorOverflows = 0;
+
+  preSteps = 0;
+  applyImpulses = 0;
+  massCacheHits = 0;
+  solverColors = 0;
+
+  fullBodySteps = 0;
+  reducedBodySteps = 0;
+  lodPromotions = 0;
+
+  broadPhaseMicros = 0;
+  particleMicros = 0;
+  integrateForcesMicros = 0;
+  preStepMicros = 0;
+  iterationsMicros = 0;
+  integrateVelocitiesMicros = 0;
+}
+
+static void PrintField(Print& out, const __FlashStringHelper* name, uint32_t value)
+{
+  out.print(name);
+  out.println(value);
+}
+
+void WorldStats::PrintTo(Print& out) const
+{
+  PrintField(out, F("steps: "), steps);
+  PrintField(out, F("adds refused: "), addsRefused);
+  PrintField(out, F("filtered pairs: "), filteredPairs);
+  PrintField(out, F("AABB rejects: "), aabbRejects);
+  PrintField(out, F("pair tests: "), pairTests);
+  PrintField(out, F("SAT early-outs: "), satEarlyOuts);
+  PrintField(out, F("clip rejects: "), clipRejects);
+  PrintField(out, F("contact points: "), contactPoints);
+  PrintField(out, F("incremental manifolds: "), incrementalManifolds);
+  PrintField(out, F("arbiter inserts: "), arbiterInserts);
+  PrintField(out, F("arbiter updates: "), arbiterUpdates);
+  PrintField(out, F("arbiter erases: "), arbiterErases);
+  PrintField(out, F("solver overflows: "), solverOverflows);
+  PrintField(out, F("arena high water: "), arenaHighWater);
+  PrintField(out, F("tile run overflows: "), tileRunOverflows);
+  PrintField(out, F("sensor overflows: "), sensorOverflows);
+  PrintField(out, F("pre-steps: "), preSteps);
+  PrintField(out, F("apply impulses: "), applyImpulses);
+  PrintField(out, F("mass cache hits: "), massCacheHits);
+  PrintField(out, F("solver colors: "), solverColors);
+  PrintField(out, F("full-rate body steps: "), fullBodySteps);
+  PrintField(out, F("reduced body steps: "), reducedBodySteps);
+  PrintField(out, F("LOD promotions: "), lodPromotions);
+  PrintField(out, F("broad phase " CYCLE_UNIT ": "), broadPhaseMicros);
+  PrintField(out, F("particles " CYCLE_UNIT ": "), particleMicros);
+  PrintField(out, F("integrate forces " CYCLE_UNIT ": "), integrateForcesMicros);
+  PrintField(out, F("pre-step " CYCLE_UNIT ": "), preStepMicros);
+  PrintField(out, F("iterations " CYCLE_UNIT ": "), iterationsMicros);
+  PrintField(out, F("integrate velocities " CYCLE_UNIT ": "), integrateVelocitiesMicros);
+}
+
+#endif
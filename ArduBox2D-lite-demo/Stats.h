@@ -0,0 +1,91 @@
+/*
+  Optional instrumentation for World::Step.
+
+  Enable with ARDUBOX2D_STATS in Config.h. Counters accumulate until Reset() so
+  the sketch can sample them every frame or average them over many frames. With
+  the option off, WorldStats is not declared and every STATS_* macro expands to
+  nothing.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "Config.h"
+
+#if ARDUBOX2D_STATS
+
+#include <Arduino.h>
+
+#include "CycleCounter.h"
+
+struct WorldStats
+{
+  WorldStats() { Reset(); }
+
+  void Reset();
+  void PrintTo(Print& out) const;
+
+  uint16_t steps;
+  uint16_t addsRefused;   // bodies World::Add turned away, see World::Add
+
+  // Narrow phase
+  uint16_t filteredPairs; // pairs skipped by category/mask/group filtering
+  uint16_t aabbRejects;   // pairs whose bounding boxes do not overlap
+  uint16_t pairTests;     // pairs handed to Collide() or TestOverlap()
+  uint16_t satEarlyOuts;  // pairs rejected by the face separation tests
+  uint16_t clipRejects;   // pairs clipped down to fewer than two points
+  uint16_t contactPoints; // contact points produced by Collide()
+  uint16_t incrementalManifolds; // pairs whose cached points were reused
+
+  // Arbiter bookkeeping
+  uint16_t arbiterInserts;
+  uint16_t arbiterUpdates;
+  uint16_t arbiterErases;
+  uint16_t solverOverflows; // pairs skipped because the step arena was full
+  uint16_t arenaHighWater;  // most bytes the step arena has held
+  uint16_t tileRunOverflows; // tile runs skipped because every slot was taken
+  uint16_t sensorOverflows;  // sensor overlaps dropped at MAX_SENSOR_OVERLAPS
+
+  // Solver
+  uint16_t preSteps;      // calls to Arbiter::PreStep
+  uint16_t applyImpulses; // calls to Arbiter::ApplyImpulse
+  uint16_t massCacheHits; // effective masses reused from the last step
+  uint8_t solverColors;   // most arbiter colors in one step (coloredSolver)
+
+  // Level of detail
+  uint16_t fullBodySteps;    // dynamic bodies moved by a full-rate step
+  uint16_t reducedBodySteps; // dynamic bodies moved by a reduced-rate step
+  uint16_t lodPromotions;    // bodies brought back to full rate
+
+  // Time spent per phase of World::Step, in microseconds, or in CPU cycles
+  // with ARDUBOX2D_CYCLE_COUNTER
+  uint32_t broadPhaseMicros;
+  uint32_t particleMicros;
+  uint32_t integrateForcesMicros;
+  uint32_t preStepMicros;
+  uint32_t iterationsMicros;
+  uint32_t integrateVelocitiesMicros;
+};
+
+#define STATS_INC(field) (++World::stats.field)
+#define STATS_ADD(field, n) (World::stats.field += (n))
+#define STATS_MAX(field, n) \
+  do { if ((n) > World::stats.field) World::stats.field = (n); } while (0)
+
+// Starts a phase timer named t; STATS_LAP adds the time since the last lap
+// to the given field and restarts the timer.
+#define STATS_TIMER(t) uint32_t t = Cycles()
+#define STATS_LAP(t, field) \
+  do { uint32_t now_ = Cycles(); World::stats.field += now_ - t; t = now_; } while (0)
+
+#else
+
+#define STATS_INC(field) ((void)0)
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_MAX(field, n) ((void)0)
+#define STATS_TIMER(t) ((void)0)
+#define STATS_LAP(t, field) ((void)0)
+
+#endif
+
+#endif
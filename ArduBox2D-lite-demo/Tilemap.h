@@ -0,0 +1,59 @@
+/*
+  Tile grid collider for static level geometry.
+
+  cells is a PROGMEM bitmap with one bit per tile, top row first, each row
+  padded to whole bytes with the most significant bit leftmost. World only
+  looks at the cells under each dynamic body's bounds, and collides against
+  whole horizontal runs of solid cells so bodies slide across a floor without
+  catching on the seams between tiles. The map must fit the SQ7x8 world.
+
+    const uint8_t level[] PROGMEM = { 0b11111111, 0b10000001, ... };
+    Tilemap map = { level, 8, 4, 4.0, Vec2(-16, 8), 0.2 };
+    world.SetTilemap(&map);
+*/
+
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <stdint.h>
+
+#include "MathUtils.h"
+
+struct Tilemap
+{
+  bool IsSolid(int column, int row) const
+  {
+    return (pgm_read_byte(cells + row * ((width + 7) / 8) + column / 8) & (0x80 >> (column % 8))) != 0;
+  }
+
+  // Cells outside the map are empty.
+  bool IsSolidCell(int column, int row) const
+  {
+    return column >= 0 && column < width && row >= 0 && row < height && IsSolid(column, row);
+  }
+
+  // Cell containing a world coordinate, possibly outside the map.
+  int ColumnAt(SQ7x8 x) const
+  {
+    return FloorDiv((int32_t)x.getInternal() - origin.x.getInternal(), tileSize.getInternal());
+  }
+
+  int RowAt(SQ7x8 y) const
+  {
+    return FloorDiv((int32_t)origin.y.getInternal() - y.getInternal(), tileSize.getInternal());
+  }
+
+  static int FloorDiv(int32_t a, int16_t b)
+  {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+  }
+
+  const uint8_t* cells;
+  uint8_t width;   // in tiles
+  uint8_t height;  // in tiles
+  SQ7x8 tileSize;
+  Vec2 origin;     // top-left corner of the map
+  SQ7x8 friction;
+};
+
+#endif
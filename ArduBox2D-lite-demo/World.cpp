@@ -1,127 +1,1176 @@
-/*
-* Copyright (c) 2006-2009 Erin Catto http://www.gphysics.com
-*
-* Permission to use, copy, modify, distribute and sell this software
-* and its documentation for any purpose is hereby granted without fee,
-* provided that the above copyright notice appear in all copies.
-* Erin Catto makes no representations about the suitability 
-* of this software for any purpose.  
-* It is provided "as is" without express or implied warranty.
-* 
-* 
-  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
-  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
-  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
-    
-*/
-
-#include "World.h"
-#include "Body.h"
-
-using std::vector;
-//using std::map; 
-using std::pair;
-
-typedef std::map<ArbiterKey, Arbiter>::iterator ArbIter;
-typedef pair<ArbiterKey, Arbiter> ArbPair;
-
-bool World::accumulateImpulses = true;
-bool World::warmStarting = true;
-bool World::positionCorrection = true;
-
-void World::Add(Body* body)
-{
-  bodies.push_back(body);
-}
-
-
-void World::Clear()
-{
-  bodies.clear();
-  arbiters.clear();
-}
-
-void World::BroadPhase()
-{
-  // O(n^2) broad-phase
-  for (int i = 0; i < (int)bodies.size(); ++i)
-  {
-    Body* bi = bodies[i];
-
-    for (int j = i + 1; j < (int)bodies.size(); ++j)
-    {
-      Body* bj = bodies[j];
-
-      if (bi->invMass == 0.0 && bj->invMass == 0.0)
-        continue;
-
-      Arbiter newArb(bi, bj);
-      ArbiterKey key(bi, bj);
-
-      if (newArb.numContacts > 0)
-      {
-        ArbIter iter = arbiters.find(key);
-        if (iter == arbiters.end())
-        {
-          arbiters.insert(ArbPair(key, newArb));
-        }
-        else
-        {
-          iter->second.Update(newArb.contacts, newArb.numContacts);
-        }
-      }
-      else
-      {
-        arbiters.erase(key);
-      }
-    }
-  }
-}
-
-void World::Step(SQ7x8 dt)
-{
-  SQ7x8 inv_dt = dt > 0.0 ? 1.0 / dt : 0.0;
-
-  // Determine overlapping bodies and update contact points.
-  BroadPhase();
-
-  // Integrate forces.
-  for (int i = 0; i < (int)bodies.size(); ++i)
-  {
-    Body* b = bodies[i];
-
-    if (b->invMass == 0.0)
-      continue;
-
-    b->velocity += dt * (gravity + b->invMass * b->force);
-    b->angularVelocity += dt * b->invI * b->torque;
-  }
-
-  // Perform pre-steps.
-  for (ArbIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
-  {
-    arb->second.PreStep(inv_dt);
-  }
-
-  // Perform iterations
-  for (int i = 0; i < iterations; ++i)
-  {
-    for (ArbIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
-    {
-      arb->second.ApplyImpulse();
-    }
-
-  }
-
-  // Integrate Velocities
-  for (int i = 0; i < (int)bodies.size(); ++i)
-  {
-    Body* b = bodies[i];
-
-    b->position += dt * b->velocity;
-    b->rotation += dt * b->angularVelocity;
-
-    b->force.Set(0.0, 0.0);
-    b->torque = 0.0;
-  }
-}
+/*
+* Copyright (c) 2006-2009 Erin Catto http://www.gphysics.com
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Erin Catto makes no representations about the suitability 
+* of this software for any purpose.  
+* It is provided "as is" without express or implied warranty.
+* 
+* 
+  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
+  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
+  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
+    
+*/
+
+#include "World.h"
+#include "Body.h"
+#include "Render.h"
+#include "SatBatch.h"
+
+using std::vector;
+//using std::map; 
+using std::pair;
+
+typedef std::map<ArbiterKey, Arbiter>::iterator ArbIter;
+typedef pair<ArbiterKey, Arbiter> ArbPair;
+
+const SQ7x8 FLT_MAX = 127.99;
+
+bool World::accumulateImpulses = true;
+bool World::warmStarting = true;
+bool World::positionCorrection = true;
+
+#if ARDUBOX2D_STATS
+WorldStats World::stats;
+#endif
+
+bool World::Add(Body* body)
+{
+  bool isStatic = body->invMass == 0.0 && !body->isKinematic;
+
+  // Past these the index would run into the static or tile range.
+  if (isStatic ? staticBodies.size() >= TILE_INDEX - STATIC_INDEX : bodies.size() >= STATIC_INDEX)
+  {
+    STATS_INC(addsRefused);
+    return false;
+  }
+
+  body->arbiterList = 0;
+  body->lod = LOD_FULL;
+  body->transformDirty = true;
+
+  if (isStatic)
+  {
+    body->index = STATIC_INDEX + staticBodies.size();
+    staticBodies.push_back(body);
+    staticsDirty = true;
+  }
+  else
+  {
+    body->index = bodies.size();
+    bodies.push_back(body);
+  }
+  return true;
+}
+
+Body* World::Create(const Vec2& width, SQ7x8 mass)
+{
+  Body* body = pool.Allocate();
+  if (body)
+  {
+    body->Set(width, mass);
+    if (!Add(body))
+    {
+      pool.Free(body);
+      return 0;
+    }
+  }
+  return body;
+}
+
+Body* World::CreateKinematic(const Vec2& width)
+{
+  Body* body = pool.Allocate();
+  if (body)
+  {
+    body->Set(width, FLT_MAX);
+    body->isKinematic = true;
+    if (!Add(body))
+    {
+      pool.Free(body);
+      return 0;
+    }
+  }
+  return body;
+}
+
+void World::Destroy(Body* body)
+{
+  while (body->arbiterList)
+  {
+    Arbiter* arb = body->arbiterList;
+    EraseArbiter(arbiters.find(ArbiterKey(arb->body1, arb->body2)));
+    STATS_INC(arbiterErases);
+  }
+
+  bool isStatic = (body->index & STATIC_INDEX) != 0;
+  std::vector<Body*>& list = isStatic ? staticBodies : bodies;
+  uint8_t base = isStatic ? STATIC_INDEX : 0;
+  uint8_t index = body->index;
+  uint8_t last = base + list.size() - 1;
+
+  if (index != last)
+  {
+    // Keep the list dense: its last body takes over the hole. Map keys are
+    // const, so each of its arbiters is reinserted under the new index.
+    Body* moved = list[last - base];
+    Arbiter* arb = moved->arbiterList;
+    moved->arbiterList = 0;
+    moved->index = index;
+    list[index - base] = moved;
+
+    while (arb)
+    {
+      uint8_t other = arb->body1 == last ? arb->body2 : arb->body1;
+      Arbiter* next = arb->body1 == last ? arb->next1 : arb->next2;
+      Arbiter old = *arb;
+
+      // Not EraseArbiter: moved's own list was already dropped above. The
+      // tile run keeps its slot, InsertArbiter takes the ref back.
+      UnlinkArbiter(arb, other);
+      if (other >= TILE_INDEX)
+        --tileRuns[other - TILE_INDEX].refs;
+      arbiters.erase(ArbiterKey(other, last));
+
+      Arbiter& a = InsertArbiter(ArbiterKey(other, index))->second;
+      // The feature ids depend on which body comes first. If the order flipped
+      // they no longer match, so the pair starts cold.
+      if ((other < last) == (other < index))
+      {
+        for (int i = 0; i < old.numContacts; ++i)
+          a.contacts[i] = old.contacts[i];
+        a.numContacts = old.numContacts;
+      }
+
+      arb = next;
+    }
+  }
+
+  list.pop_back();
+  if (isStatic)
+    staticsDirty = true;
+
+  if (pool.Owns(body))
+    pool.Free(body);
+}
+
+void World::LinkArbiter(Arbiter* arb, uint8_t body)
+{
+  Body* b = GetBody(body);
+  if (arb->body1 == body)
+    arb->next1 = b->arbiterList;
+  else
+    arb->next2 = b->arbiterList;
+  b->arbiterList = arb;
+}
+
+void World::UnlinkArbiter(Arbiter* arb, uint8_t body)
+{
+  // Lists are as long as the number of bodies touching this one.
+  Arbiter** link = &GetBody(body)->arbiterList;
+  while (*link != arb)
+    link = (*link)->body1 == body ? &(*link)->next1 : &(*link)->next2;
+  *link = arb->body1 == body ? arb->next1 : arb->next2;
+}
+
+ArbIter World::InsertArbiter(const ArbiterKey& key)
+{
+  std::pair<ArbIter, bool> result = arbiters.insert(ArbPair(key, Arbiter(key, GetBody(key.body1), GetBody(key.body2))));
+  if (result.second)
+  {
+    LinkArbiter(&result.first->second, key.body1);
+    LinkArbiter(&result.first->second, key.body2);
+    if (key.body2 >= TILE_INDEX)
+      ++tileRuns[key.body2 - TILE_INDEX].refs;
+  }
+  return result.first;
+}
+
+void World::EraseArbiter(ArbIter iter)
+{
+  UnlinkArbiter(&iter->second, iter->first.body1);
+  UnlinkArbiter(&iter->second, iter->first.body2);
+  if (iter->first.body2 >= TILE_INDEX)
+    --tileRuns[iter->first.body2 - TILE_INDEX].refs;
+  arbiters.erase(iter);
+}
+
+void World::ClearArbiters()
+{
+  arbiters.clear();
+  for (int i = 0; i < (int)bodies.size(); ++i)
+    bodies[i]->arbiterList = 0;
+  for (int i = 0; i < (int)staticBodies.size(); ++i)
+    staticBodies[i]->arbiterList = 0;
+  tileBody.arbiterList = 0;
+  for (int i = 0; i < MAX_TILE_RUNS; ++i)
+    tileRuns[i].refs = 0;
+}
+
+void World::SetTilemap(const Tilemap* map)
+{
+  while (tileBody.arbiterList)
+  {
+    Arbiter* arb = tileBody.arbiterList;
+    EraseArbiter(arbiters.find(ArbiterKey(arb->body1, arb->body2)));
+  }
+
+  tilemap = map;
+  if (map)
+    tileBody.friction = map->friction;
+}
+
+void World::Clear()
+{
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    if (pool.Owns(bodies[i]))
+      pool.Free(bodies[i]);
+  }
+  for (int i = 0; i < (int)staticBodies.size(); ++i)
+  {
+    if (pool.Owns(staticBodies[i]))
+      pool.Free(staticBodies[i]);
+  }
+
+  ClearArbiters();
+  bodies.clear();
+  staticBodies.clear();
+  staticRotations.clear();
+  staticOrder.clear();
+  staticsDirty = false;
+  arena.Reset();
+  solverContacts = 0;
+  numSolverContacts = 0;
+  numSensorOverlaps = 0;
+  numContactEvents = 0;
+  droppedContactEvents = 0;
+}
+
+int World::QueryAABB(const AABB& box, Body** results, int maxResults) const
+{
+  int count = 0;
+  for (int i = 0; i < (int)bodies.size() && count < maxResults; ++i)
+  {
+    if (Overlaps(bodies[i]->aabb, box))
+      results[count++] = bodies[i];
+  }
+  for (int i = 0; i < (int)staticBodies.size() && count < maxResults; ++i)
+  {
+    if (Overlaps(staticBodies[i]->aabb, box))
+      results[count++] = staticBodies[i];
+  }
+  return count;
+}
+
+// Clips the segment p + t * d, t in [tMin, tMax], against the slab |x| <= h.
+// Tracks which side the segment entered through in enterSign.
+static bool ClipToSlab(float p, float d, float h, float& tMin, float& tMax, float& enterSign)
+{
+  if (d == 0.0f)
+    return p >= -h && p <= h;
+
+  float t1 = (-h - p) / d;
+  float t2 = (h - p) / d;
+  float sign = -1.0f;
+  if (t1 > t2)
+  {
+    Swap(t1, t2);
+    sign = 1.0f;
+  }
+
+  if (t1 > tMin)
+  {
+    tMin = t1;
+    enterSign = sign;
+  }
+  if (t2 < tMax)
+    tMax = t2;
+
+  return tMin <= tMax;
+}
+
+Body* World::RayCast(const Vec2& p1, const Vec2& p2, RayCastHit* hit) const
+{
+  AABB segmentBox;
+  segmentBox.lowerBound.Set(Min(p1.x, p2.x), Min(p1.y, p2.y));
+  segmentBox.upperBound.Set(Max(p1.x, p2.x), Max(p1.y, p2.y));
+
+  Body* closest = 0;
+  float closestT = 1.0f;
+  Vec2 closestNormal;
+
+  int numBodies = bodies.size();
+  for (int i = 0; i < numBodies + (int)staticBodies.size(); ++i)
+  {
+    Body* b = i < numBodies ? bodies[i] : staticBodies[i - numBodies];
+    if (!Overlaps(b->aabb, segmentBox))
+      continue;
+
+    // Slab test in the box frame. Done in float: the slab divisions
+    // overflow SQ7x8 for nearly parallel rays, and queries are rare.
+    Mat22 R(b->rotation);
+    Mat22 RT = R.Transpose();
+    Vec2 p = RT * (p1 - b->position);
+    Vec2 d = RT * (p2 - p1);
+
+    float tMin = 0.0f, tMax = closestT;
+    float signX = 0.0f, signY = 0.0f;
+    float enterX = -1.0f, enterY = -1.0f;
+
+    if (!ClipToSlab(static_cast<float>(p.x), static_cast<float>(d.x), 0.5f * static_cast<float>(b->width.x), tMin, tMax, signX))
+      continue;
+    enterX = tMin;
+    if (!ClipToSlab(static_cast<float>(p.y), static_cast<float>(d.y), 0.5f * static_cast<float>(b->width.y), tMin, tMax, signY))
+      continue;
+    enterY = tMin;
+
+    // A ray starting inside the box does not hit it.
+    if (tMin <= 0.0f)
+      continue;
+
+    closest = b;
+    closestT = tMin;
+    closestNormal = enterY > enterX ? Sign(signY) * R.col2 : Sign(signX) * R.col1;
+  }
+
+  if (closest && hit)
+  {
+    hit->fraction = closestT;
+    hit->normal = closestNormal;
+  }
+  return closest;
+}
+
+void World::AddContactEvent(const ArbiterKey& key, uint8_t type)
+{
+  if (numContactEvents == MAX_CONTACT_EVENTS)
+  {
+    if (droppedContactEvents < 0xFF)
+      ++droppedContactEvents;
+    return;
+  }
+
+  ContactEvent& e = contactEvents[numContactEvents++];
+  e.body1 = GetBody(key.body1);
+  e.body2 = GetBody(key.body2);
+  e.type = type;
+}
+
+void World::EndContact(const ArbiterKey& key)
+{
+  ArbIter iter = arbiters.find(key);
+  if (iter != arbiters.end())
+  {
+    EraseArbiter(iter);
+    STATS_INC(arbiterErases);
+    AddContactEvent(key, CONTACT_END);
+  }
+}
+
+// Out of scratch memory: keep the arbiter and its warm-start data, but leave
+// it out of this step.
+void World::SkipContact(const ArbiterKey& key)
+{
+  STATS_INC(solverOverflows);
+  ArbIter iter = arbiters.find(key);
+  if (iter != arbiters.end())
+    iter->second.firstSolverContact = Arbiter::NO_SOLVER_CONTACTS;
+}
+
+void World::UpdateStatics()
+{
+  staticRotations.resize(staticBodies.size());
+  staticOrder.resize(staticBodies.size());
+
+  for (int i = 0; i < (int)staticBodies.size(); ++i)
+  {
+    staticBodies[i]->UpdateTransform();
+    staticRotations[i] = Mat22(staticBodies[i]->rotation);
+
+    // Insertion sort: this only runs when the level changes.
+    int j = i;
+    for (; j > 0 && staticBodies[staticOrder[j - 1]]->aabb.lowerBound.x > staticBodies[i]->aabb.lowerBound.x; --j)
+      staticOrder[j] = staticOrder[j - 1];
+    staticOrder[j] = i;
+  }
+
+  staticsDirty = false;
+}
+
+// Filters a pair and, if it needs Collide(), appends it to pairs.
+void World::AddPair(uint8_t i, uint8_t j, ArbiterKey* pairs, int& numPairs)
+{
+  Body* bi = GetBody(i);
+  Body* bj = GetBody(j);
+  ArbiterKey key(i, j);
+
+  // Filtered pairs skip Collide() entirely. The erase only matters if the
+  // filter changed while the bodies were touching.
+  if (!ShouldCollide(bi, bj))
+  {
+    STATS_INC(filteredPairs);
+    EndContact(key);
+    return;
+  }
+
+  if (!Overlaps(bi->aabb, bj->aabb))
+  {
+    STATS_INC(aabbRejects);
+    EndContact(key);
+    return;
+  }
+
+  if (bi->isSensor || bj->isSensor)
+  {
+    // Sensors get no arbiters, but the pair may have had one from before
+    // either body became a sensor. Left alone, it would keep last step's
+    // firstSolverContact.
+    EndContact(key);
+
+    if (TestOverlap(bi, bj))
+    {
+      if (numSensorOverlaps < MAX_SENSOR_OVERLAPS)
+      {
+        SensorOverlap& overlap = sensorOverlaps[numSensorOverlaps++];
+        overlap.sensor = bi->isSensor ? bi : bj;
+        overlap.other = bi->isSensor ? bj : bi;
+      }
+      else
+      {
+        STATS_INC(sensorOverflows);
+      }
+    }
+    return;
+  }
+
+  if (arena.Allocate<ArbiterKey>(1))
+    pairs[numPairs++] = key;
+  else
+    SkipContact(key);
+}
+
+// Collects the tile runs under body i's bounds. Runs are merged across the
+// whole row, not just the part under the body, so a slot keeps naming the
+// same run while the body slides along it.
+void World::AddTilePairs(uint8_t i, ArbiterKey* pairs, int& numPairs)
+{
+  const Tilemap& map = *tilemap;
+  const AABB& box = bodies[i]->aabb;
+  int16_t size = map.tileSize.getInternal();
+
+  int column0 = map.ColumnAt(box.lowerBound.x);
+  int column1 = map.ColumnAt(box.upperBound.x);
+  int row0 = map.RowAt(box.upperBound.y);
+  int row1 = map.RowAt(box.lowerBound.y);
+  if (column0 < 0) column0 = 0;
+  if (column1 >= map.width) column1 = map.width - 1;
+  if (row0 < 0) row0 = 0;
+  if (row1 >= map.height) row1 = map.height - 1;
+
+  // Long runs are cut at fixed points so the box stays within SQ7x8 range.
+  int maxLength = (96L << 8) / size;
+  if (maxLength < 1) maxLength = 1;
+
+  uint16_t touched = 0;
+  for (int row = row0; row <= row1; ++row)
+  {
+    int column = column0;
+    while (column <= column1)
+    {
+      if (!map.IsSolid(column, row))
+      {
+        ++column;
+        continue;
+      }
+
+      int start = column;
+      while (start > 0 && map.IsSolid(start - 1, row))
+        --start;
+      int end = column + 1;
+      while (end < map.width && map.IsSolid(end, row))
+        ++end;
+
+      start += (column - start) / maxLength * maxLength;
+      if (end > start + maxLength)
+        end = start + maxLength;
+      column = end;
+
+      uint8_t slot = FindTileRun(row, start, end - start);
+      if (slot == MAX_TILE_RUNS)
+      {
+        STATS_INC(tileRunOverflows);
+        continue;
+      }
+
+      touched |= 1 << slot;
+      LoadTileRun(slot);
+      AddPair(i, TILE_INDEX + slot, pairs, numPairs);
+    }
+  }
+
+  // Drop contacts with runs the body has left.
+  for (Arbiter* arb = bodies[i]->arbiterList; arb; )
+  {
+    Arbiter* next = arb->body1 == i ? arb->next1 : arb->next2;
+    if (arb->body2 >= TILE_INDEX && !(touched & (1 << (arb->body2 - TILE_INDEX))))
+      EndContact(ArbiterKey(arb->body1, arb->body2));
+    arb = next;
+  }
+}
+
+// Returns the slot already naming this run, or a free one, or MAX_TILE_RUNS.
+uint8_t World::FindTileRun(uint8_t row, uint8_t column, uint8_t length)
+{
+  uint8_t freeSlot = MAX_TILE_RUNS;
+  for (uint8_t s = 0; s < MAX_TILE_RUNS; ++s)
+  {
+    TileRun& run = tileRuns[s];
+    bool inUse = run.refs > 0 || (tileRunsInStep & (1 << s));
+    if (inUse && run.row == row && run.column == column)
+    {
+      tileRunsInStep |= 1 << s;
+      return s;
+    }
+    if (!inUse && freeSlot == MAX_TILE_RUNS)
+      freeSlot = s;
+  }
+
+  if (freeSlot < MAX_TILE_RUNS)
+  {
+    TileRun& run = tileRuns[freeSlot];
+    run.row = row;
+    run.column = column;
+    run.length = length;
+    tileRunsInStep |= 1 << freeSlot;
+  }
+  return freeSlot;
+}
+
+// Shapes tileBody like the run in slot.
+void World::LoadTileRun(uint8_t slot)
+{
+  const TileRun& run = tileRuns[slot];
+  int16_t size = tilemap->tileSize.getInternal();
+  int16_t width = size * run.length;
+
+  tileBody.width = Vec2(SQ7x8::fromInternal(width), tilemap->tileSize);
+  tileBody.position = Vec2(
+    SQ7x8::fromInternal(tilemap->origin.x.getInternal() + size * run.column + width / 2),
+    SQ7x8::fromInternal(tilemap->origin.y.getInternal() - size * run.row - size / 2));
+  tileBody.UpdateTransform();
+}
+
+void World::SetRenderBuffer(RenderBuffer* buffer)
+{
+  renderBuffer = buffer;
+  if (buffer)
+    buffer->Publish(*this);
+}
+
+void World::SetParticles(Particle* particles, uint8_t count)
+{
+  this->particles = particles;
+  numParticles = particles ? count : 0;
+}
+
+// Pushes p out of box b through the nearest face and bounces it off the
+// face's motion. Returns true on a hit.
+static bool CollideParticle(Particle& p, const Body* b, const Mat22& R, SQ7x8 restitution)
+{
+  Vec2 h = 0.5 * b->width;
+  Vec2 d = p.position - b->position;
+  Vec2 local = R.Transpose() * d;
+  Vec2 depth = h - Abs(local);
+  if (depth.x <= 0.0 || depth.y <= 0.0)
+    return false;
+
+  Vec2 normal;
+  if (depth.x < depth.y)
+  {
+    normal = local.x > 0.0 ? R.col1 : -R.col1;
+    p.position += depth.x * normal;
+  }
+  else
+  {
+    normal = local.y > 0.0 ? R.col2 : -R.col2;
+    p.position += depth.y * normal;
+  }
+
+  Vec2 surfaceVelocity = b->velocity + Cross(b->angularVelocity, d);
+  SQ7x8 vn = Dot(p.velocity - surfaceVelocity, normal);
+  if (vn < 0.0)
+    p.velocity -= ((SQ7x8)1.0 + restitution) * vn * normal;
+  return true;
+}
+
+// Moves the particle one axis at a time, x first, and stops it at the edge
+// of the first solid tile it enters on each axis.
+void World::CollideParticleWithTiles(Particle& p, const Vec2& oldPosition)
+{
+  const Tilemap& map = *tilemap;
+  int16_t size = map.tileSize.getInternal();
+  int oldColumn = map.ColumnAt(oldPosition.x);
+  int oldRow = map.RowAt(oldPosition.y);
+
+  int column = map.ColumnAt(p.position.x);
+  if (column != oldColumn && map.IsSolidCell(column, oldRow))
+  {
+    int16_t edge = map.origin.x.getInternal() + size * (oldColumn < column ? column : column + 1);
+    p.position.x = SQ7x8::fromInternal(oldColumn < column ? edge - 1 : edge);
+    p.velocity.x = -particleRestitution * p.velocity.x;
+    column = oldColumn;
+  }
+
+  int row = map.RowAt(p.position.y);
+  if (row != oldRow && map.IsSolidCell(column, row))
+  {
+    int16_t edge = map.origin.y.getInternal() - size * (oldRow < row ? row : row + 1);
+    p.position.y = SQ7x8::fromInternal(oldRow < row ? edge + 1 : edge);
+    p.velocity.y = -particleRestitution * p.velocity.y;
+  }
+}
+
+void World::StepParticles(SQ7x8 dt)
+{
+  for (int n = 0; n < numParticles; ++n)
+  {
+    Particle& p = particles[n];
+    Vec2 oldPosition = p.position;
+    p.velocity += dt * gravity;
+    p.position += dt * p.velocity;
+
+    for (int i = 0; i < (int)bodies.size(); ++i)
+    {
+      Body* b = bodies[i];
+      if (!b->isSensor && b->aabb.lowerBound.x < p.position.x && p.position.x < b->aabb.upperBound.x &&
+          b->aabb.lowerBound.y < p.position.y && p.position.y < b->aabb.upperBound.y)
+        CollideParticle(p, b, Mat22(b->rotation), particleRestitution);
+    }
+
+    for (int i = 0; i < (int)staticBodies.size(); ++i)
+    {
+      Body* b = staticBodies[i];
+      if (!b->isSensor && b->aabb.lowerBound.x < p.position.x && p.position.x < b->aabb.upperBound.x &&
+          b->aabb.lowerBound.y < p.position.y && p.position.y < b->aabb.upperBound.y)
+        CollideParticle(p, b, staticRotations[i], particleRestitution);
+    }
+
+    if (tilemap)
+      CollideParticleWithTiles(p, oldPosition);
+  }
+}
+
+// The rotation of a pair's body2. Statics keep theirs from UpdateStatics.
+Mat22 World::PairRotation(const ArbiterKey& key)
+{
+  bool isStatic = (key.body2 & STATIC_INDEX) && key.body2 < TILE_INDEX;
+  return isStatic ? staticRotations[key.body2 & ~STATIC_INDEX] : Mat22(GetBody(key.body2)->rotation);
+}
+
+void World::BroadPhase()
+{
+  arena.Reset();
+  numSolverContacts = 0;
+
+  // A reduced-rate pass adds to the events of the full-rate pass before it.
+  if (stepLod != LOD_REDUCED)
+  {
+    numSensorOverlaps = 0;
+    numContactEvents = 0;
+    droppedContactEvents = 0;
+  }
+
+  if (staticsDirty)
+    UpdateStatics();
+  tileRunsInStep = 0;
+
+  // Bodies that did not move keep last step's bounds and vertices.
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    if (InStep(bodies[i]) && bodies[i]->transformDirty)
+      bodies[i]->UpdateTransform();
+  }
+
+  // Collect the pairs that need Collide(): O(n^2) over the dynamic bodies,
+  // plus each dynamic body against the statics whose bounds start left of its
+  // right edge.
+  ArbiterKey* pairs = arena.Allocate<ArbiterKey>(0);
+  int numPairs = 0;
+
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    // Bodies at another level of detail keep their arbiters untouched;
+    // UpdateLevelsOfDetail never leaves two of them touching.
+    if (!InStep(bodies[i]))
+      continue;
+
+    bool kinematic = bodies[i]->isKinematic;
+    for (int j = i + 1; j < (int)bodies.size(); ++j)
+    {
+      if ((!kinematic || !bodies[j]->isKinematic) && InStep(bodies[j]))
+        AddPair(i, j, pairs, numPairs);
+    }
+
+    // Kinematic bodies follow their velocity whatever is in the way.
+    if (kinematic)
+      continue;
+
+    SQ7x8 right = bodies[i]->aabb.upperBound.x;
+
+    // Statics past the cutoff are never visited, so drop their contacts from
+    // the body's own arbiter list. In mixed pairs the static is always body2.
+    for (Arbiter* arb = bodies[i]->arbiterList; arb; )
+    {
+      Arbiter* next = arb->body1 == i ? arb->next1 : arb->next2;
+      if ((arb->body2 & STATIC_INDEX) && arb->body2 < TILE_INDEX && GetBody(arb->body2)->aabb.lowerBound.x > right)
+      {
+        STATS_INC(aabbRejects);
+        EndContact(ArbiterKey(arb->body1, arb->body2));
+      }
+      arb = next;
+    }
+
+    for (int k = 0; k < (int)staticOrder.size(); ++k)
+    {
+      uint8_t s = staticOrder[k];
+      if (staticBodies[s]->aabb.lowerBound.x > right)
+        break;
+      AddPair(i, STATIC_INDEX + s, pairs, numPairs);
+    }
+
+    if (tilemap)
+      AddTilePairs(i, pairs, numPairs);
+  }
+
+  // Narrow phase. Each pair's points are allocated right after the previous
+  // pair's, so the solver contacts for the whole step form one array.
+  solverContacts = arena.Allocate<SolverContact>(0);
+
+#if ARDUBOX2D_SAT_BATCH
+  SatBatch batch;
+  uint8_t separated = 0;
+#endif
+
+  for (int n = 0; n < numPairs; ++n)
+  {
+#if ARDUBOX2D_SAT_BATCH
+    // Face tests for the next few pairs at once. A separated pair still takes
+    // its share of the arena below, so running out of room ends the same
+    // arbiters as the scalar path does.
+    if (n % SAT_BATCH_SIZE == 0)
+    {
+      for (int m = n; m < numPairs && m < n + SAT_BATCH_SIZE; ++m)
+      {
+        const ArbiterKey& key = pairs[m];
+        if (key.body2 >= TILE_INDEX)
+          LoadTileRun(key.body2 - TILE_INDEX);
+        batch.Add(GetBody(key.body1), Mat22(GetBody(key.body1)->rotation), GetBody(key.body2), PairRotation(key));
+      }
+      separated = batch.Separated();
+    }
+#endif
+
+    const ArbiterKey& key = pairs[n];
+    Body* bi = GetBody(key.body1);
+    Body* bj = GetBody(key.body2);
+    if (key.body2 >= TILE_INDEX)
+      LoadTileRun(key.body2 - TILE_INDEX);
+    Mat22 Rj = PairRotation(key);
+
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+    // New pairs start with an empty cache, which makes UpdateManifold clip.
+    ArbIter found = arbiters.find(key);
+    ManifoldCache manifold;
+    if (found != arbiters.end())
+      manifold = found->second.manifold;
+#endif
+
+    // Past NO_SOLVER_CONTACTS - MAX_POINTS the indices would wrap, so those
+    // pairs sit the step out as if the arena were full.
+    uint16_t mark = arena.Mark();
+    SolverContact* newContacts = 0;
+    if (numSolverContacts < Arbiter::NO_SOLVER_CONTACTS - Arbiter::MAX_POINTS)
+      newContacts = arena.Allocate<SolverContact>(Arbiter::MAX_POINTS);
+    int numNewContacts;
+    if (!newContacts)
+    {
+      numNewContacts = -1;
+    }
+#if ARDUBOX2D_SAT_BATCH
+    else if (separated & (1 << (n % SAT_BATCH_SIZE)))
+    {
+      STATS_INC(pairTests);
+      STATS_INC(satEarlyOuts);
+      numNewContacts = 0;
+    }
+#endif
+    else
+    {
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+      numNewContacts = UpdateManifold(newContacts, bi, Mat22(bi->rotation), bj, Rj, arena, manifold);
+#else
+      numNewContacts = Collide(newContacts, bi, Mat22(bi->rotation), bj, Rj, arena);
+#endif
+    }
+
+    if (numNewContacts < 0)
+    {
+      arena.Rewind(mark);
+      SkipContact(key);
+    }
+    else if (numNewContacts > 0)
+    {
+      ArbIter iter = arbiters.find(key);
+      if (iter == arbiters.end())
+      {
+        iter = InsertArbiter(key);
+        STATS_INC(arbiterInserts);
+        AddContactEvent(key, CONTACT_BEGIN);
+      }
+      else
+      {
+        STATS_INC(arbiterUpdates);
+        if (reportPersistEvents)
+          AddContactEvent(key, CONTACT_PERSIST);
+      }
+
+      // Hand back the points Collide() did not use.
+      arena.Rewind(mark);
+      arena.Allocate<SolverContact>(numNewContacts);
+
+      iter->second.Update(newContacts, numNewContacts);
+      iter->second.firstSolverContact = numSolverContacts;
+#if ARDUBOX2D_INCREMENTAL_MANIFOLD
+      iter->second.manifold = manifold;
+#endif
+      numSolverContacts += numNewContacts;
+    }
+    else
+    {
+      arena.Rewind(mark);
+      EndContact(key);
+    }
+  }
+
+  STATS_MAX(arenaHighWater, arena.highWater);
+}
+
+// Picks which bodies run at reduced rate this step. Bodies drop to
+// LOD_REDUCED only at the start of an interval, so none gets more time than
+// it waited for.
+void World::UpdateLevelsOfDetail()
+{
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    Body* b = bodies[i];
+
+    // Bounds as of the bodies' current positions, whichever pass last moved
+    // them, so that the choice depends on nothing a snapshot does not keep.
+    if (b->transformDirty)
+      b->UpdateTransform();
+
+    if (b->lod == LOD_FULL && lodFrame == 0)
+    {
+      if (!Overlaps(b->aabb, view))
+        b->lod = LOD_REDUCED;
+    }
+    else if (b->lod == LOD_REDUCED && Overlaps(b->aabb, view))
+    {
+      Promote(b);
+    }
+  }
+
+  // A promoted body can be touching reduced ones in turn, so repeat until
+  // nothing changes. Mixed pairs never reach BroadPhase.
+  bool promoted = true;
+  while (promoted)
+  {
+    promoted = false;
+    for (int i = 0; i < (int)bodies.size(); ++i)
+    {
+      Body* b = bodies[i];
+      if (b->lod != LOD_REDUCED)
+        continue;
+
+      for (int j = 0; j < (int)bodies.size(); ++j)
+      {
+        if (bodies[j]->lod == LOD_FULL && Overlaps(b->aabb, bodies[j]->aabb))
+        {
+          Promote(b);
+          promoted = true;
+          break;
+        }
+      }
+      if (b->lod != LOD_REDUCED)
+        continue;
+
+      // Contacts that outlive the bounds overlap, e.g. resting ones.
+      for (Arbiter* arb = b->arbiterList; arb; arb = arb->body1 == i ? arb->next1 : arb->next2)
+      {
+        uint8_t other = arb->body1 == i ? arb->body2 : arb->body1;
+        if (!(other & STATIC_INDEX) && bodies[other]->lod == LOD_FULL)
+        {
+          Promote(b);
+          promoted = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+void World::Promote(Body* body)
+{
+  body->lod = LOD_FULL;
+  STATS_INC(lodPromotions);
+}
+
+void World::Step(SQ7x8 dt)
+{
+  StepWith<SolverPolicy>(dt);
+}
+
+void World::BeginStep(SQ7x8 dt)
+{
+  BeginStepWith<SolverPolicy>(dt);
+}
+
+void World::EndStep()
+{
+  EndStepWith<SolverPolicy>();
+}
+
+template<class Policy>
+void World::StepWith(SQ7x8 dt)
+{
+  BeginStepWith<Policy>(dt);
+  EndStepWith<Policy>();
+}
+
+template<class Policy>
+void World::BeginStepWith(SQ7x8 dt)
+{
+  STATS_INC(steps);
+
+  if (!hasView || lodInterval <= 1)
+  {
+    stepLod = LOD_ALL;
+  }
+  else
+  {
+    UpdateLevelsOfDetail();
+    stepLod = LOD_FULL;
+  }
+
+  stepDt = dt;
+  BeginLevel<Policy>(dt);
+}
+
+// The reduced-rate pass, when one is due, runs whole here.
+template<class Policy>
+void World::EndStepWith()
+{
+  EndLevel<Policy>(stepDt, iterations);
+
+  if (stepLod == LOD_FULL)
+  {
+    lodTime += stepDt;
+    if (++lodFrame >= lodInterval)
+    {
+      stepLod = LOD_REDUCED;
+      BeginLevel<Policy>(lodTime);
+      EndLevel<Policy>(lodTime, lodIterations);
+      lodFrame = 0;
+      lodTime = 0.0;
+    }
+  }
+
+  stepLod = LOD_ALL;
+
+  if (renderBuffer)
+    renderBuffer->Publish(*this);
+}
+
+// First half of a step of the bodies at stepLod: contacts, forces and
+// pre-steps.
+template<class Policy>
+void World::BeginLevel(SQ7x8 dt)
+{
+  SQ7x8 inv_dt = dt > 0.0 ? Reciprocal(dt) : 0.0;
+
+  STATS_TIMER(timer);
+
+  // Determine overlapping bodies and update contact points.
+  BroadPhase();
+  STATS_LAP(timer, broadPhaseMicros);
+
+  // Particles see the bodies where BroadPhase found them.
+  if (stepLod != LOD_REDUCED)
+    StepParticles(dt);
+  STATS_LAP(timer, particleMicros);
+
+  // Integrate forces.
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    Body* b = bodies[i];
+
+    if (b->invMass == 0.0 || !InStep(b))
+      continue;
+
+    b->velocity += dt * (gravity + b->invMass * b->force);
+    b->angularVelocity += dt * b->invI * b->torque;
+  }
+  STATS_LAP(timer, integrateForcesMicros);
+
+  // Perform pre-steps. body1 is always in bodies.
+  for (ArbIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+  {
+    if (InStep(bodies[arb->first.body1]))
+      arb->second.PreStep<Policy>(*this, inv_dt);
+  }
+  STATS_LAP(timer, preStepMicros);
+}
+
+// Second half: solver iterations and integration.
+template<class Policy>
+void World::EndLevel(SQ7x8 dt, int numIterations)
+{
+  STATS_TIMER(timer);
+
+  // Perform iterations
+#if ARDUBOX2D_COLORED_SOLVER
+  if (coloredSolver)
+  {
+    ColorArbiters();
+    for (int i = 0; i < numIterations; ++i)
+      SolveColors<Policy>();
+  }
+  else
+#endif
+  for (int i = 0; i < numIterations; ++i)
+  {
+    for (ArbIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+    {
+      if (InStep(bodies[arb->first.body1]))
+        arb->second.ApplyImpulse<Policy>(*this);
+    }
+
+  }
+  STATS_LAP(timer, iterationsMicros);
+
+  // Integrate Velocities
+  for (int i = 0; i < (int)bodies.size(); ++i)
+  {
+    Body* b = bodies[i];
+    if (!InStep(b))
+      continue;
+
+    if (stepLod == LOD_REDUCED)
+      STATS_INC(reducedBodySteps);
+    else
+      STATS_INC(fullBodySteps);
+
+    // Slow bodies often move less than one fixed-point step, and then
+    // keep their transform.
+    Vec2 dp = dt * b->velocity;
+    SQ7x8 dr = dt * b->angularVelocity;
+    if (dp.x != 0.0 || dp.y != 0.0 || dr != 0.0)
+    {
+      b->position += dp;
+      b->rotation += dr;
+      b->transformDirty = true;
+    }
+
+    b->force.Set(0.0, 0.0);
+    b->torque = 0.0;
+  }
+  STATS_LAP(timer, integrateVelocitiesMicros);
+}
+
+#if ARDUBOX2D_COLORED_SOLVER
+
+// Greedy coloring in arbiter order: each arbiter takes the lowest color that
+// neither of its bodies has used yet. Statics and tile runs take no impulse,
+// so only bodies in bodies constrain the choice.
+void World::ColorArbiters()
+{
+  std::vector<uint32_t> usedColors(bodies.size(), 0);
+  std::vector<uint8_t> colors;
+  colors.reserve(arbiters.size());
+  uint16_t counts[MAX_COLORS + 1] = {0};
+  numColors = 0;
+
+  for (ArbIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+  {
+    const ArbiterKey& key = arb->first;
+    if (!InStep(bodies[key.body1]) || arb->second.firstSolverContact == Arbiter::NO_SOLVER_CONTACTS)
+      continue;
+
+    bool dynamic2 = !(key.body2 & STATIC_INDEX);
+    uint32_t used = usedColors[key.body1] | (dynamic2 ? usedColors[key.body2] : 0);
+    uint8_t color = 0;
+    while (color < MAX_COLORS && (used & (1UL << color)))
+      ++color;
+
+    if (color < MAX_COLORS)
+    {
+      usedColors[key.body1] |= 1UL << color;
+      if (dynamic2)
+        usedColors[key.body2] |= 1UL << color;
+      if (color >= numColors)
+        numColors = color + 1;
+    }
+    colors.push_back(color);
+    ++counts[color];
+  }
+
+  colorStart[0] = 0;
+  for (int c = 0; c <= MAX_COLORS; ++c)
+    colorStart[c + 1] = colorStart[c] + counts[c];
+
+  // Second pass in the same order, so each color keeps arbiter order.
+  colorOrder.resize(colors.size());
+  uint16_t next[MAX_COLORS + 1];
+  for (int c = 0; c <= MAX_COLORS; ++c)
+    next[c] = colorStart[c];
+  int n = 0;
+  for (ArbIter arb = arbiters.begin(); arb != arbiters.end(); ++arb)
+  {
+    const ArbiterKey& key = arb->first;
+    if (!InStep(bodies[key.body1]) || arb->second.firstSolverContact == Arbiter::NO_SOLVER_CONTACTS)
+      continue;
+    colorOrder[next[colors[n++]]++] = &arb->second;
+  }
+
+  STATS_MAX(solverColors, numColors);
+}
+
+// One solver iteration. Arbiters of a color touch disjoint bodies, so the
+// threads' results do not depend on which of them runs first. The stats
+// counters are not thread safe, so they keep everything on one thread.
+template<class Policy>
+void World::SolveColors()
+{
+  for (int c = 0; c < numColors; ++c)
+  {
+    int begin = colorStart[c];
+    int end = colorStart[c + 1];
+#if defined(_OPENMP) && !ARDUBOX2D_STATS
+#pragma omp parallel for if (end - begin >= MIN_PARALLEL_ARBITERS)
+#endif
+    for (int k = begin; k < end; ++k)
+      colorOrder[k]->ApplyImpulse<Policy>(*this);
+  }
+
+  for (int k = colorStart[MAX_COLORS]; k < colorStart[MAX_COLORS + 1]; ++k)
+    colorOrder[k]->ApplyImpulse<Policy>(*this);
+}
+
+#endif
+
+template void World::StepWith<DefaultSolverPolicy>(SQ7x8);
+template void World::StepWith<RuntimeSolverPolicy>(SQ7x8);
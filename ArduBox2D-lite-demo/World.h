@@ -1,48 +1,333 @@
-/*
-* Copyright (c) 2006-2009 Erin Catto http://www.gphysics.com
-*
-* Permission to use, copy, modify, distribute and sell this software
-* and its documentation for any purpose is hereby granted without fee,
-* provided that the above copyright notice appear in all copies.
-* Erin Catto makes no representations about the suitability 
-* of this software for any purpose.  
-* It is provided "as is" without express or implied warranty.
-* 
-* 
-  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
-  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
-  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
-    
-*/
-
-#ifndef WORLD_H
-#define WORLD_H
-
-#include <vector>
-#include <map>
-#include "MathUtils.h"
-#include "Arbiter.h"
-
-struct Body;
-
-struct World
-{
-  World(Vec2 gravity, int iterations) : gravity(gravity), iterations(iterations) {}
-
-  void Add(Body* body);
-  void Clear();
-
-  void Step(SQ7x8 dt);
-
-  void BroadPhase();
-
-  std::vector<Body*> bodies;
-  std::map<ArbiterKey, Arbiter> arbiters;
-  Vec2 gravity;
-  int iterations;
-  static bool accumulateImpulses;
-  static bool warmStarting;
-  static bool positionCorrection;
-};
-
-#endif
+/*
+* Copyright (c) 2006-2009 Erin Catto http://www.gphysics.com
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Erin Catto makes no representations about the suitability 
+* of this software for any purpose.  
+* It is provided "as is" without express or implied warranty.
+* 
+* 
+  - Crudely modified to to use SQ7x8 fixed point numbers instead of floating points for small micros
+  - Required: Pharap's  FixedPointsArduino library https://github.com/Pharap/FixedPointsArduino/
+  -           mike-matera's ArduinoSTL library https://github.com/mike-matera/ArduinoSTL
+    
+*/
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <vector>
+#include <map>
+#include "MathUtils.h"
+#include "Arbiter.h"
+#include "Arena.h"
+#include "BodyPool.h"
+#include "Particle.h"
+#include "Stats.h"
+#include "Tilemap.h"
+
+#ifndef ARDUBOX2D_MAX_SENSOR_OVERLAPS
+#define ARDUBOX2D_MAX_SENSOR_OVERLAPS 4
+#endif
+
+#ifndef ARDUBOX2D_MAX_CONTACT_EVENTS
+#define ARDUBOX2D_MAX_CONTACT_EVENTS 4
+#endif
+
+// Tile runs that can be in contact at once. At most 16.
+#ifndef ARDUBOX2D_MAX_TILE_RUNS
+#define ARDUBOX2D_MAX_TILE_RUNS 8
+#endif
+
+struct DefaultSolverPolicy;
+struct RuntimeSolverPolicy;
+struct RenderBuffer;
+
+typedef ARDUBOX2D_SOLVER_POLICY SolverPolicy;
+
+struct SensorOverlap
+{
+  Body* sensor;
+  Body* other;
+};
+
+enum ContactEventType
+{
+  CONTACT_BEGIN,
+  CONTACT_PERSIST,
+  CONTACT_END
+};
+
+struct ContactEvent
+{
+  Body* body1;
+  Body* body2;
+  uint8_t type;
+};
+
+// A horizontal run of solid tiles that some body is touching.
+struct TileRun
+{
+  uint8_t row;
+  uint8_t column;
+  uint8_t length;
+  uint8_t refs;    // arbiters using this slot
+};
+
+struct RayCastHit
+{
+  SQ7x8 fraction; // along the segment, 0 at p1 and 1 at p2
+  Vec2 normal;
+};
+
+struct World
+{
+  // Body::index of a static body: its slot in staticBodies plus STATIC_INDEX.
+  // Indices from TILE_INDEX up name tile runs, see SetTilemap.
+  enum {STATIC_INDEX = 0x80};
+  enum {TILE_INDEX = 0xF0};
+  enum {MAX_TILE_RUNS = ARDUBOX2D_MAX_TILE_RUNS};
+  enum {MAX_SENSOR_OVERLAPS = ARDUBOX2D_MAX_SENSOR_OVERLAPS};
+  enum {MAX_CONTACT_EVENTS = ARDUBOX2D_MAX_CONTACT_EVENTS};
+  enum {LOD_FULL, LOD_REDUCED};
+
+  World(Vec2 gravity, int iterations) : tilemap(0), renderBuffer(0), particles(0), numParticles(0), particleRestitution(0.5),
+    gravity(gravity), iterations(iterations), hasView(false), lodInterval(4), lodIterations(2), lodFrame(0), lodTime(0),
+    solverContacts(0), numSolverContacts(0), numSensorOverlaps(0), numContactEvents(0), droppedContactEvents(0), reportPersistEvents(false),
+    staticsDirty(false), tileRunsInStep(0), stepLod(LOD_ALL), stepDt(0)
+  {
+    for (int i = 0; i < MAX_TILE_RUNS; ++i)
+      tileRuns[i].refs = 0;
+#if ARDUBOX2D_COLORED_SOLVER
+    coloredSolver = false;
+#endif
+  }
+
+  // Bodies with invMass == 0 when added go to staticBodies, the rest
+  // (including kinematic bodies) to bodies. Up to 128 dynamic and 112 static
+  // bodies; past that the body is not added, Add returns false and
+  // stats.addsRefused counts it.
+  bool Add(Body* body);
+  void Clear();
+
+  // Static bodies are never integrated and only tested against dynamic ones.
+  // Their bounds, rotation and sort order are computed at the first step after
+  // one is added or destroyed; call RefreshStatics() after moving one.
+  void RefreshStatics() { staticsDirty = true; }
+
+  // Tile collision, see Tilemap.h. Pass 0 to remove the map. Contacts with
+  // the map report tileBody as the other body; its filter fields apply to
+  // every tile.
+  void SetTilemap(const Tilemap* map);
+
+  // Particles moved by every Step, see Particle.h. The array stays owned by
+  // the caller; pass 0 to stop.
+  void SetParticles(Particle* particles, uint8_t count);
+
+  // Render state published after every step, see Render.h. The buffer stays
+  // owned by the caller and is filled once right away; pass 0 to stop.
+  void SetRenderBuffer(RenderBuffer* buffer);
+
+  Body* GetBody(uint8_t index)
+  {
+    if (index >= TILE_INDEX)
+      return &tileBody;
+    return index & STATIC_INDEX ? staticBodies[index & ~STATIC_INDEX] : bodies[index];
+  }
+
+  bool HasBody(uint8_t index) const
+  {
+    if (index >= TILE_INDEX)
+      return index - TILE_INDEX < MAX_TILE_RUNS;
+    return index & STATIC_INDEX ? (index & ~STATIC_INDEX) < (int)staticBodies.size() : index < (int)bodies.size();
+  }
+
+  // Pooled bodies. Create takes a slot from the pool, Sets it up and adds it;
+  // it returns 0 when the pool is empty or Add refuses the body. Destroy removes any body, pooled or
+  // added, together with its arbiters, and moves the last body into its slot
+  // in bodies. Call them between steps: events and sensor overlaps from the
+  // last step are not updated and may still name a destroyed body.
+  Body* Create(const Vec2& width, SQ7x8 mass);
+  Body* CreateKinematic(const Vec2& width);
+  void Destroy(Body* body);
+
+  // Arbiter bookkeeping: each arbiter is also linked into both of its bodies'
+  // arbiter lists, so anything that adds or removes arbiters goes through these.
+  std::map<ArbiterKey, Arbiter>::iterator InsertArbiter(const ArbiterKey& key);
+  void EraseArbiter(std::map<ArbiterKey, Arbiter>::iterator iter);
+
+  void Step(SQ7x8 dt);
+
+  // Step split in two, e.g. to draw the last published render state between
+  // the halves. BeginStep finds the contacts and runs the pre-steps, EndStep
+  // runs the solver and integrates, then publishes. Step(dt) is the same as
+  // BeginStep(dt) followed by EndStep(). Leave the world alone in between:
+  // the step arena holds the contacts.
+  void BeginStep(SQ7x8 dt);
+  void EndStep();
+
+  // Simulation level of detail. Once a view is set, Step runs dynamic bodies
+  // outside it at LOD_REDUCED: they sit still for lodInterval - 1 steps, then
+  // take one step of the time they skipped with lodIterations solver
+  // iterations. A body comes back to LOD_FULL as soon as its bounds touch the
+  // view or a full-rate body, dropping the time it had not caught up on yet.
+  // Bodies only drop to LOD_REDUCED at the start of an interval.
+  void SetView(const AABB& box) { view = box; hasView = true; }
+  void ClearView() { hasView = false; }
+
+  // Step with an explicit solver policy, e.g. to compare policies in one build.
+  template<class Policy> void StepWith(SQ7x8 dt);
+
+  void BroadPhase();
+
+  // Queries against the body bounds computed by the last BroadPhase. QueryAABB
+  // writes up to maxResults overlapping bodies and returns how many it wrote.
+  // RayCast returns the closest body hit by the segment p1-p2, or 0.
+  int QueryAABB(const AABB& box, Body** results, int maxResults) const;
+  Body* RayCast(const Vec2& p1, const Vec2& p2, RayCastHit* hit = 0) const;
+
+  // Deterministic snapshots, see Snapshot.h. SaveSnapshot returns the number
+  // of bytes written, or 0 if the buffer is too small. LoadSnapshot expects the
+  // world to hold as many bodies as the snapshot, added in the same order.
+  // Static bodies are level data and are not saved. LoadSnapshot checks the
+  // whole buffer first and returns false, leaving the world untouched, if it
+  // is truncated or corrupt or was saved with solver flags this build's
+  // policy cannot run.
+  size_t SaveSnapshot(uint8_t* buffer, size_t capacity) const;
+  bool LoadSnapshot(const uint8_t* buffer, size_t size);
+
+  std::vector<Body*> bodies;
+  std::vector<Body*> staticBodies;
+  std::map<ArbiterKey, Arbiter> arbiters;
+  BodyPool pool;
+  const Tilemap* tilemap;
+  Body tileBody;
+
+  // Tile runs in contact, addressed by TILE_INDEX + slot. A slot is free when
+  // no arbiter uses it and it was not handed out this step. Snapshots and
+  // checkpoints save the run of each tile arbiter.
+  TileRun tileRuns[MAX_TILE_RUNS];
+  RenderBuffer* renderBuffer;
+  Particle* particles;
+  uint8_t numParticles;
+  SQ7x8 particleRestitution;
+  Vec2 gravity;
+  int iterations;
+
+  AABB view;
+  bool hasView;
+  uint8_t lodInterval;
+  uint8_t lodIterations;
+
+  // Steps into the current LOD interval and the time they covered. Kept by
+  // Step; snapshots and checkpoints save them with each Body::lod.
+  uint8_t lodFrame;
+  SQ7x8 lodTime;
+
+  // Scratch memory for the current step. BroadPhase allocates the per-step
+  // contact data for every arbiter from it; solverContacts points at the first.
+  StepArena arena;
+  SolverContact* solverContacts;
+  SolverIndex numSolverContacts;
+
+  // Sensor overlaps found by the last BroadPhase. Overlaps beyond
+  // MAX_SENSOR_OVERLAPS are dropped (counted in stats.sensorOverflows).
+  SensorOverlap sensorOverlaps[MAX_SENSOR_OVERLAPS];
+  uint8_t numSensorOverlaps;
+
+  // Contacts that began, persisted or ended during the last BroadPhase.
+  // Persist events are only reported when reportPersistEvents is set. Events
+  // beyond MAX_CONTACT_EVENTS are counted in droppedContactEvents.
+  ContactEvent contactEvents[MAX_CONTACT_EVENTS];
+  uint8_t numContactEvents;
+  uint8_t droppedContactEvents;
+  bool reportPersistEvents;
+
+#if ARDUBOX2D_COLORED_SOLVER
+  // Run the solver iterations color by color instead of in arbiter order.
+  // Off by default; can be switched between steps.
+  bool coloredSolver;
+#endif
+
+  // Only read by RuntimeSolverPolicy.
+  static bool accumulateImpulses;
+  static bool warmStarting;
+  static bool positionCorrection;
+
+#if ARDUBOX2D_STATS
+  static WorldStats stats;
+#endif
+
+private:
+  enum {LOD_ALL = 0xFF};
+
+  template<class Policy> void BeginStepWith(SQ7x8 dt);
+  template<class Policy> void EndStepWith();
+  template<class Policy> void BeginLevel(SQ7x8 dt);
+  template<class Policy> void EndLevel(SQ7x8 dt, int numIterations);
+  void UpdateLevelsOfDetail();
+  void Promote(Body* body);
+  bool InStep(const Body* body) const { return stepLod == LOD_ALL || body->lod == stepLod; }
+  void UpdateStatics();
+  void AddPair(uint8_t i, uint8_t j, ArbiterKey* pairs, int& numPairs);
+  void AddTilePairs(uint8_t i, ArbiterKey* pairs, int& numPairs);
+  uint8_t FindTileRun(uint8_t row, uint8_t column, uint8_t length);
+  void LoadTileRun(uint8_t slot);
+  Mat22 PairRotation(const ArbiterKey& key);
+#if ARDUBOX2D_COLORED_SOLVER
+  void ColorArbiters();
+  template<class Policy> void SolveColors();
+#endif
+  void StepParticles(SQ7x8 dt);
+  void CollideParticleWithTiles(Particle& p, const Vec2& oldPosition);
+  void ClearArbiters();
+  void LinkArbiter(Arbiter* arb, uint8_t body);
+  void UnlinkArbiter(Arbiter* arb, uint8_t body);
+  void AddContactEvent(const ArbiterKey& key, uint8_t type);
+  void EndContact(const ArbiterKey& key);
+  void SkipContact(const ArbiterKey& key);
+
+  // Cached for staticBodies by UpdateStatics: rotation of each static body,
+  // and their slots sorted by aabb.lowerBound.x.
+  std::vector<Mat22> staticRotations;
+  std::vector<uint8_t> staticOrder;
+  bool staticsDirty;
+
+  // Bit per tileRuns slot handed out by the running step.
+  uint16_t tileRunsInStep;
+
+  // Which bodies the running step moves: LOD_FULL, LOD_REDUCED or LOD_ALL.
+  uint8_t stepLod;
+
+  // dt of the step between BeginStep and EndStep.
+  SQ7x8 stepDt;
+
+#if ARDUBOX2D_COLORED_SOLVER
+  // The running step's arbiters grouped by color: color c is colorOrder from
+  // colorStart[c] up to colorStart[c + 1]. Group MAX_COLORS holds arbiters
+  // whose bodies had used up every color; it is solved one at a time.
+  enum {MAX_COLORS = 32};
+  enum {MIN_PARALLEL_ARBITERS = 16};
+  std::vector<Arbiter*> colorOrder;
+  uint16_t colorStart[MAX_COLORS + 2];
+  uint8_t numColors;
+#endif
+};
+
+struct DefaultSolverPolicy
+{
+  static bool AccumulateImpulses() { return true; }
+  static bool WarmStarting() { return true; }
+  static bool PositionCorrection() { return true; }
+};
+
+struct RuntimeSolverPolicy
+{
+  static bool AccumulateImpulses() { return World::accumulateImpulses; }
+  static bool WarmStarting() { return World::warmStarting; }
+  static bool PositionCorrection() { return World::positionCorrection; }
+};
+
+#endif